@@ -0,0 +1,136 @@
+#ifndef AUTOTUNE_CC
+#define AUTOTUNE_CC
+
+#include <cmath>
+#include <vector>
+#include <omp.h>
+#include "./quadtree.cc"
+
+// exact pairwise interaction terms on point i, as summed by the naive swarm solver
+void exact_rhs(const std::vector<double> &x, const size_t n, double J, double K, size_t i, double out[3]) {
+    size_t xi = 3*i, yi = 3*i + 1, ti = 3*i + 2;
+    out[0] = out[1] = out[2] = 0.;
+    for(size_t j = 0; j < n; j++) {
+        if (j == i) continue;
+        size_t xj = 3*j, yj = 3*j + 1, tj = 3*j + 2;
+        double dx = x[xj] - x[xi],
+               dy = x[yj] - x[yi],
+               dth = x[tj] - x[ti],
+               distance_sq = (dx*dx+dy*dy),
+               distance = sqrt(distance_sq),
+               xdot_contrib = (((1. + J*cos(dth))/distance - 1./distance_sq))/n;
+
+        out[0] += xdot_contrib * dx;
+        out[1] += xdot_contrib * dy;
+        out[2] += K/n*sin(dth)/distance;
+    }
+}
+
+// interaction terms on point i approximated by a walk of tree, returns the number of interactions
+// and adds the nodes walked onto visits
+size_t tree_rhs(const QuadTree &tree, const std::vector<double> &x, const size_t n, double J, double K,
+              size_t i, const Opening &open, double out[3], size_t *visits = NULL) {
+    size_t xi = 3*i, yi = 3*i + 1, ti = 3*i + 2;
+    std::vector<double> js;
+    tree.collect(x[xi], x[yi], open, js, visits);
+    out[0] = out[1] = out[2] = 0.;
+    for(size_t j = 0; j < js.size() / 5; j++) {
+        size_t xj = 5*j, yj = 5*j + 1, tj = 5*j + 2, mj = 5*j + 3, rj = 5*j + 4;
+        double dx = js[xj] - x[xi],
+               dy = js[yj] - x[yi],
+               dth = js[tj] - x[ti],
+               distance_sq = (dx*dx+dy*dy),
+               distance = sqrt(distance_sq),
+               xdot_contrib = (((1. + J*js[rj]*cos(dth))/distance - 1./distance_sq))/n;
+
+        out[0] += xdot_contrib * dx * js[mj];
+        out[1] += xdot_contrib * dy * js[mj];
+        out[2] += K/n*js[rj]*sin(dth)/distance * js[mj];
+    }
+    return js.size() / 5;
+}
+
+// modelled cost of one right-hand side evaluation, in units of one pair interaction, so that the
+// choice of leaf size depends only on the state and runs with the same seed stay reproducible
+// weights fitted (rounded) to timed builds and walks at n = 2e3 .. 2e5: a node visited by a walk costs
+// about half an interaction, a centroid update while building 1.5 and allocating a node 6
+const double visit_cost = 0.5, build_step_cost = 1.5, node_cost = 6.;
+
+// outcome of a tuning pass: chosen opening criterion and leaf size,
+// measured relative error on the samples and modelled cost per right-hand side evaluation
+struct Tuning {
+    Opening open;
+    size_t leaf_size;
+    double error, cost;
+
+    Tuning(Opening open = Opening(), size_t leaf_size = 1, double error = 0, double cost = 0):
+        open(open), leaf_size(leaf_size), error(error), cost(cost) {}
+};
+
+// picks the cheapest opening parameter (theta, or delta if bounded) and leaf size whose
+// forces on a strided sample of points are within target relative error of the exact pairwise sums
+Tuning autotune(const std::vector<double> &x, const size_t n, double J, double K, double target,
+                bool bounded, size_t samples = 64, size_t offset = 0) {
+    // candidates ordered from loosest (cheapest) to tightest
+    const double thetas[] = {1.5, 1., 0.7, 0.5, 0.35, 0.25, 0.15, 0.1};
+    const double deltas[] = {0.3, 0.1, 0.03, 0.01, 0.003, 0.001, 0.0003};
+    const size_t leaf_sizes[] = {1, 2, 4, 8, 16, 32};
+    const size_t n_params = bounded ? sizeof(deltas) / sizeof(double) : sizeof(thetas) / sizeof(double);
+    const size_t n_leaves = sizeof(leaf_sizes) / sizeof(size_t);
+
+    if (samples > n) samples = n;
+    std::vector<size_t> idx(samples);
+    for(size_t s = 0; s < samples; s++) {
+        idx[s] = (offset + s * (n / samples)) % n;
+    }
+
+    std::vector<double> exact(3*samples);
+    double norm = 0.;
+#pragma omp parallel for schedule(dynamic)
+    for(size_t s = 0; s < samples; s++) {
+        exact_rhs(x, n, J, K, idx[s], &exact[3*s]);
+    }
+    // summed in order, so the error and the choice do not depend on the thread count
+    for(size_t k = 0; k < 3*samples; k++) {
+        norm += exact[k]*exact[k];
+    }
+
+    Tuning best;
+    bool found = false;
+    for(size_t l = 0; l < n_leaves; l++) {
+        QuadTree tree(Box(), leaf_sizes[l]);
+        for(size_t i = 0; i < n; i++) {
+            tree.insert(Point(x[3*i], x[3*i + 1], x[3*i + 2]));
+        }
+        double build = build_step_cost * tree.build_steps() + node_cost * tree.node_count();
+
+        for(size_t p = 0; p < n_params; p++) {
+            Opening open = bounded ? Opening(0.5, deltas[p]) : Opening(thetas[p]);
+            double diff = 0., out[3];
+            size_t interactions = 0, visits = 0;
+            for(size_t s = 0; s < samples; s++) {
+                interactions += tree_rhs(tree, x, n, J, K, idx[s], open, out, &visits);
+                for(size_t k = 0; k < 3; k++) {
+                    diff += (out[k] - exact[3*s + k]) * (out[k] - exact[3*s + k]);
+                }
+            }
+            double walk = (interactions + visit_cost * visits) / samples * n;
+            double error = norm > 0 ? sqrt(diff / norm) : 0.;
+
+            if (error <= target) {
+                if (!found || build + walk < best.cost) {
+                    best = Tuning(open, leaf_sizes[l], error, build + walk);
+                    found = true;
+                }
+                break;
+            }
+            // tightest candidate on single point leaves is kept when nothing reaches the target
+            if (!found && l == 0 && p == n_params - 1) {
+                best = Tuning(open, leaf_sizes[l], error, build + walk);
+            }
+        }
+    }
+    return best;
+}
+
+#endif
@@ -7,6 +7,7 @@
 #include <omp.h>
 #include <mpi.h>
 #include "./quadtree.cc"
+#include "./random.cc"
 
 using namespace std;
 using namespace boost::numeric::odeint;
@@ -48,15 +49,15 @@ struct swarm_barnes_hut {
         for(size_t i = 0; i < n; i++) {
             size_t xi = 3*i, yi = 3*i + 1, ti = 3*i + 2;
             std::vector<double> js = tree.get_centroids(x[xi], x[yi], theta);
-            for(size_t j = 0; j < js.size() / 4; j++) {
-                size_t xj = 4*j, yj = 4*j + 1, tj = 4*j + 2, mj = 4*j + 3;
+            for(size_t j = 0; j < js.size() / 5; j++) {
+                size_t xj = 5*j, yj = 5*j + 1, tj = 5*j + 2, mj = 5*j + 3, rj = 5*j + 4;
                 double dx = js[xj] - x[xi],
                        dy = js[yj] - x[yi],
                        dth = js[tj] - x[ti],
                        distance_sq = (dx*dx+dy*dy),
                        distance = sqrt(distance_sq),
-                       xdot_contrib = (((1. + J*cos(dth))/distance - 1./distance_sq))/n,
-                       tdot = K/n*sin(dth)/distance,
+                       xdot_contrib = (((1. + J*js[rj]*cos(dth))/distance - 1./distance_sq))/n,
+                       tdot = K/n*js[rj]*sin(dth)/distance,
                        xdot = xdot_contrib * dx,
                        ydot = xdot_contrib * dy;
 
@@ -86,7 +87,6 @@ int main(int argc, char **argv) {
     boost::mpi::environment env(argc, argv);
     boost::mpi::communicator world;
 
-    srand(time(NULL));
     const size_t n = 500;
     const double dt = 0.1;
 
@@ -98,20 +98,17 @@ int main(int argc, char **argv) {
     const double J = 1, K = -0.1;
     const double theta_threshold = 0.5;
 
+    // initial condition shape and seed, see random.cc
+    const Shape shape = DISK;
+    const uint64_t seed = 6;
+
     vector<double> x(3*n);
 
-    if(world.rank() == 0){
-    #pragma omp parallel for
-    for(size_t i = 0; i < n; i++) {
-        double r = ((double) rand())/((double) RAND_MAX)*1.;
-        double theta = ((double) rand())/((double) RAND_MAX)*2.*M_PI;
-        x[3*i] = r*cos(theta);
-        x[3*i + 1] = r*sin(theta);
-        x[3*i + 2] = ((double) rand())/((double) RAND_MAX)*2.*M_PI;
-    }
+    // every rank draws the same full state from the counter-based generator
+    initial_conditions(x, seed, shape, 0, n);
 
+    if(world.rank() == 0){
         print_points(n, x, false);
-        
     }
     
     // number of parallel threads
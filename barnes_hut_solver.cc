@@ -6,58 +6,97 @@
 #include <omp.h>
 //#include <mpi.h>
 #include "./quadtree.cc"
+#include "./autotune.cc"
+#include "./random.cc"
+#include "./low_storage_rk.cc"
+#include "./memory.cc"
+#include "./observables.cc"
+#include "./run.cc"
+#include "./kernels.cc"
 using namespace std;
 using namespace boost::numeric::odeint;
 
-#pragma omp declare reduction(vec_add : std::vector<double> : \
-                              std::transform(omp_out.begin(), omp_out.end(), omp_in.begin(), omp_out.begin(), std::plus<double>())) \
-                    initializer(omp_priv = omp_orig)
-
 struct swarm_barnes_hut {
     vector<double> omega;
     const size_t n;
-    double J, K, theta;
-
-    swarm_barnes_hut(const size_t n_, double J_, double K_, double theta_):
-        n(n_), omega(n_, 0.1), J(J_), K(K_), theta(theta_) {}
+    double J, K, omega0;
+    bool repulsion;
+    // opening criterion and leaf size of the tree, set by the autotuner in error-estimated mode
+    Opening open;
+    size_t leaf_size;
+    // tree walk specialized for J, K, omega and repulsion, chosen once in the constructor
+    typedef void (swarm_barnes_hut::*kernel_type)(const vector<double> &, vector<double> &) const;
+    kernel_type kernel;
+
+    swarm_barnes_hut(const size_t n_, double J_, double K_, double theta_, const vector<double> &omega_,
+                     bool repulsion_ = true):
+        n(n_), omega(omega_), J(J_), K(K_), omega0(omega_[0]), repulsion(repulsion_),
+        open(theta_), leaf_size(1),
+        kernel(select_kernel<swarm_barnes_hut>(J_, K_, is_heterogeneous(omega_), repulsion_)) {}
 
     void operator()(const vector<double> &x, vector<double> &dxdt, double t) const {
+        std::fill(dxdt.begin(), dxdt.end(), 0.);
+        accumulate(x, dxdt, t);
+    }
+
+    // add time derivatives onto dxdt, used directly by the low-storage integrator
+    void accumulate(const vector<double> &x, vector<double> &dxdt, double t) const {
+        (this->*kernel)(x, dxdt);
+    }
+
+    template<class M>
+    void accumulate_model(const vector<double> &x, vector<double> &dxdt) const {
         // initialize QuadTree
-        QuadTree tree;
+        QuadTree tree(Box(), leaf_size);
 
         for(size_t i = 0; i < n; i++) {
             size_t xi = 3*i, yi = 3*i + 1, ti = 3*i + 2;
-            dxdt[xi] = 0.;
-            dxdt[yi] = 0.;
-            dxdt[ti] = 0.1;
+            dxdt[ti] += natural_frequency<M>(omega, omega0, i);
             // insert each point into the tree
             tree.insert(Point(x[xi], x[yi], x[ti]));
         }
 
-#pragma omp parallel for reduction(vec_add:dxdt) schedule(dynamic)
+        // each point only updates its own derivatives, so no per-thread copy of dxdt is needed
+#pragma omp parallel for schedule(dynamic)
         for(size_t i = 0; i < n; i++) {
             size_t xi = 3*i, yi = 3*i + 1, ti = 3*i + 2;
-            std::vector<double> js = tree.get_centroids(x[xi], x[yi], theta);
-            for(size_t j = 0; j < js.size() / 4; j++) {
-                size_t xj = 4*j, yj = 4*j + 1, tj = 4*j + 2, mj = 4*j + 3;
+            std::vector<double> js = tree.get_centroids(x[xi], x[yi], open);
+            for(size_t j = 0; j < js.size() / 5; j++) {
+                size_t xj = 5*j, yj = 5*j + 1, tj = 5*j + 2, mj = 5*j + 3, rj = 5*j + 4;
                 double dx = js[xj] - x[xi],
                        dy = js[yj] - x[yi],
-                       dth = js[tj] - x[ti],
-                       distance_sq = (dx*dx+dy*dy),
-                       distance = sqrt(distance_sq),
-                       xdot_contrib = (((1. + J*cos(dth))/distance - 1./distance_sq))/n,
-                       tdot = K/n*sin(dth)/distance,
-                       xdot = xdot_contrib * dx,
-                       ydot = xdot_contrib * dy;
-
-                dxdt[xi] += xdot * js[mj];
-                dxdt[yi] += ydot * js[mj];
-                dxdt[ti] += tdot * js[mj];
+                       xdot_contrib, tdot;
+                interaction<M>(dx, dy, js[tj] - x[ti], J, K, xdot_contrib, tdot, js[rj]);
+
+                dxdt[xi] += xdot_contrib/n * dx * js[mj];
+                dxdt[yi] += xdot_contrib/n * dy * js[mj];
+                if (M::k_term) dxdt[ti] += tdot/n * js[mj];
             }
         }
     }
 };
 
+// observer that reruns the autotuner on the current state every few steps
+struct retune_observer {
+    swarm_barnes_hut &group;
+    double target;
+    bool bounded;
+    size_t every, steps;
+
+    retune_observer(swarm_barnes_hut &group_, double target_, bool bounded_, size_t every_):
+        group(group_), target(target_), bounded(bounded_), every(every_), steps(0) {}
+
+    void operator()(const vector<double> &x, const vector<double> &dxdt, double t) {
+        if (target <= 0 || steps++ % every != 0) return;
+        Tuning tuned = autotune(x, group.n, group.J, group.K, target, bounded, 64, steps);
+        group.open = tuned.open;
+        group.leaf_size = tuned.leaf_size;
+        printf("t = %.1f: %s = %g, leaf size = %zu, sampled error = %g\n", t,
+               bounded ? "delta" : "theta", bounded ? tuned.open.delta : tuned.open.theta,
+               tuned.leaf_size, tuned.error);
+    }
+};
+
 void print_points(const size_t n, const vector<double> &x, bool final) {
    	ofstream file;
     file.open(final ? "final.csv" : "init.csv");
@@ -74,7 +113,6 @@ int main(int argc, char **argv) {
 //	MPI_Comm_rank(MPI_COMM_WORLD, &rank);
 //	MPI_Comm_size(MPI_COMM_WORLD, &size);
 
-    srand(time(NULL));
     const size_t n = stoi(argv[2]);
     const double dt = 0.1;
 
@@ -85,28 +123,37 @@ int main(int argc, char **argv) {
     // (1, -0.75) mixed rainbow
     const double J = 1, K = -0.1;
     const double theta_threshold = 0.5;
+    // optional relative force error target, enables the autotuner
+    // error-estimated opening criterion by default, geometric theta if the fourth argument is "theta"
+    const double target = argc > 3 ? stod(argv[3]) : 0.;
+    const bool bounded = argc <= 4 || string(argv[4]) != "theta";
+    const size_t retune_every = 50;
+    // integrator, in-situ observables and early stopping, see RunOptions in run.cc
+    const RunOptions options;
+
+    // initial condition shape and seed, see random.cc
+    const Shape shape = DISK;
+    const uint64_t seed = 6;
+    // natural frequencies, see random.cc - IDENTICAL gives omega_i = 0.1 for all points
+    const Frequencies frequencies = IDENTICAL;
+    const double omega_mean = 0.1, omega_width = 0.;
 
-    vector<double> x(3*n);
+    // number of parallel threads
+    omp_set_num_threads(stoi(argv[1]));
 
-    for(size_t i = 0; i < n; i++) {
-        double r = ((double) rand())/((double) RAND_MAX)*1.;
-        double theta = ((double) rand())/((double) RAND_MAX)*2.*M_PI;
-        x[3*i] = r*cos(theta);
-        x[3*i + 1] = r*sin(theta);
-        x[3*i + 2] = ((double) rand())/((double) RAND_MAX)*2.*M_PI;
-    }
+    vector<double> x(3*n);
+    initial_conditions(x, seed, shape, 0, n);
 
     print_points(n, x, false);
 
-    // number of parallel threads
-    omp_set_num_threads(stoi(argv[1]));
+    vector<double> omega(n);
+    natural_frequencies(omega, seed, frequencies, omega_mean, omega_width, 0, n);
 
-    swarm_barnes_hut group(n, J, K, theta_threshold);
-    double t0 = omp_get_wtime();
-    integrate_const(runge_kutta4< vector<double> >(), boost::ref(group), x, 0., 50., dt);
-    // if (rank == 0) {
-    	printf("Time taken: %f\n", omp_get_wtime()-t0);
-    // }
+    swarm_barnes_hut group(n, J, K, theta_threshold, omega);
+    // retuning runs from the same integration as the in-situ observables
+    retune_observer retune(group, target, bounded, retune_every);
+    run(group, x, dt, options, retune);
+    print_memory(n);
     print_points(n, x, true);
 //    MPI_Finalize();
 
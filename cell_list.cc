@@ -0,0 +1,187 @@
+#ifndef CELL_LIST_CC
+#define CELL_LIST_CC
+
+#include <cmath>
+#include <vector>
+#include <algorithm>
+#include <omp.h>
+
+// uniform grid of square cells over the bounding box of the points, points sorted by cell
+// the points of cell c are order[start[c]] .. order[start[c + 1] - 1]
+struct CellList {
+    double min_x, min_y, cell_size;
+    size_t side;
+    std::vector<size_t> start, order, cell;
+
+    // bin the n points of x into cells no smaller than width, at most max_cells cells in total
+    void build(const std::vector<double> &x, const size_t n, double width, size_t max_cells) {
+        double lo_x = x[0], hi_x = x[0], lo_y = x[1], hi_y = x[1];
+#pragma omp parallel for reduction(min:lo_x,lo_y) reduction(max:hi_x,hi_y)
+        for(size_t i = 0; i < n; i++) {
+            lo_x = std::min(lo_x, x[3*i]);
+            hi_x = std::max(hi_x, x[3*i]);
+            lo_y = std::min(lo_y, x[3*i + 1]);
+            hi_y = std::max(hi_y, x[3*i + 1]);
+        }
+        min_x = lo_x;
+        min_y = lo_y;
+        double extent = std::max(hi_x - lo_x, hi_y - lo_y);
+        side = std::max((size_t) 1, (size_t) (extent / width));
+        side = std::min(side, std::max((size_t) 1, (size_t) sqrt((double) max_cells)));
+        cell_size = std::max(extent / side, width) * (1. + 1e-12);
+
+        // counting sort by cell, points of a cell in increasing index so the order is the same for
+        // any thread count
+        const size_t n_cells = side * side;
+        cell.resize(n);
+        order.resize(n);
+        start.assign(n_cells + 1, 0);
+        int n_threads = omp_get_max_threads();
+        if ((size_t) n_threads * n_cells <= n) {
+            bin_per_thread(x, n, n_threads);
+        } else {
+            bin_atomic(x, n);
+        }
+    }
+
+    // each thread bins a contiguous block of points into its own histogram, n_threads x n_cells words
+    void bin_per_thread(const std::vector<double> &x, const size_t n, int n_threads) {
+        const size_t n_cells = side * side;
+        std::vector<size_t> counts(n_threads * n_cells, 0);
+#pragma omp parallel num_threads(n_threads)
+        {
+            int tid = omp_get_thread_num(), nt = omp_get_num_threads();
+            size_t begin = n * tid / nt, end = n * (tid + 1) / nt;
+            size_t *count = &counts[tid * n_cells];
+            for(size_t i = begin; i < end; i++) {
+                cell[i] = cell_of(x[3*i], x[3*i + 1]);
+                count[cell[i]]++;
+            }
+#pragma omp barrier
+#pragma omp single
+            {
+                // exclusive prefix sum over cells, then over threads within each cell
+                size_t offset = 0;
+                for(size_t c = 0; c < n_cells; c++) {
+                    start[c] = offset;
+                    for(int t = 0; t < nt; t++) {
+                        size_t k = counts[t * n_cells + c];
+                        counts[t * n_cells + c] = offset;
+                        offset += k;
+                    }
+                }
+                start[n_cells] = offset;
+            }
+            for(size_t i = begin; i < end; i++) {
+                order[count[cell[i]]++] = i;
+            }
+        }
+    }
+
+    // one shared histogram with atomic counts, for cells too many to histogram per thread
+    // (small width at large n), then each cell sorted to undo the arbitrary order of the fill
+    void bin_atomic(const std::vector<double> &x, const size_t n) {
+        const size_t n_cells = side * side;
+        std::vector<size_t> count(n_cells, 0);
+#pragma omp parallel for
+        for(size_t i = 0; i < n; i++) {
+            cell[i] = cell_of(x[3*i], x[3*i + 1]);
+#pragma omp atomic
+            count[cell[i]]++;
+        }
+        size_t offset = 0;
+        for(size_t c = 0; c < n_cells; c++) {
+            start[c] = offset;
+            offset += count[c];
+            count[c] = start[c];
+        }
+        start[n_cells] = offset;
+#pragma omp parallel for
+        for(size_t i = 0; i < n; i++) {
+            size_t slot;
+#pragma omp atomic capture
+            slot = count[cell[i]]++;
+            order[slot] = i;
+        }
+#pragma omp parallel for schedule(dynamic, 1024)
+        for(size_t c = 0; c < n_cells; c++) {
+            std::sort(order.begin() + start[c], order.begin() + start[c + 1]);
+        }
+    }
+
+    size_t cell_of(double px, double py) const {
+        size_t cx = std::min(side - 1, (size_t) ((px - min_x) / cell_size));
+        size_t cy = std::min(side - 1, (size_t) ((py - min_y) / cell_size));
+        return cy * side + cx;
+    }
+};
+
+// Verlet neighbour lists: for every point, the points within cutoff + skin at the time of the build
+// the lists stay valid until some point has moved more than skin / 2 from where it was at the build
+// the neighbours of point i are neighbours[start[i]] .. neighbours[start[i + 1] - 1]
+struct NeighbourList {
+    double cutoff, skin;
+    std::vector<size_t> start, neighbours;
+    // positions at the last build, x and y only, the velocity does not decide staleness
+    std::vector<double> reference;
+    CellList cells;
+    size_t builds;
+
+    NeighbourList(double cutoff = 1, double skin = 0.1):
+        cutoff(cutoff), skin(skin), builds(0) {}
+
+    // true if x has drifted far enough from the last build to miss a pair within cutoff
+    bool stale(const std::vector<double> &x, const size_t n) const {
+        if (reference.size() != 2*n) return true;
+        double limit = 0.25 * skin * skin, drift = 0.;
+#pragma omp parallel for reduction(max:drift)
+        for(size_t i = 0; i < n; i++) {
+            double dx = x[3*i] - reference[2*i], dy = x[3*i + 1] - reference[2*i + 1];
+            drift = std::max(drift, dx*dx + dy*dy);
+        }
+        return drift > limit;
+    }
+
+    void build(const std::vector<double> &x, const size_t n) {
+        const double range = cutoff + skin, range_sq = range * range;
+        cells.build(x, n, range, n);
+        reference.resize(2*n);
+        for(size_t i = 0; i < n; i++) {
+            reference[2*i] = x[3*i];
+            reference[2*i + 1] = x[3*i + 1];
+        }
+        start.assign(n + 1, 0);
+
+        // two passes over the 3 x 3 cell neighbourhood of each point, count then fill
+        for(int pass = 0; pass < 2; pass++) {
+#pragma omp parallel for schedule(dynamic, 64)
+            for(size_t i = 0; i < n; i++) {
+                size_t c = cells.cell[i], cx = c % cells.side, cy = c / cells.side, k = pass == 0 ? 0 : start[i];
+                size_t x_lo = cx > 0 ? cx - 1 : 0, x_hi = std::min(cells.side - 1, cx + 1);
+                size_t y_lo = cy > 0 ? cy - 1 : 0, y_hi = std::min(cells.side - 1, cy + 1);
+                for(size_t ny = y_lo; ny <= y_hi; ny++) {
+                    for(size_t nx = x_lo; nx <= x_hi; nx++) {
+                        size_t nc = ny * cells.side + nx;
+                        for(size_t s = cells.start[nc]; s < cells.start[nc + 1]; s++) {
+                            size_t j = cells.order[s];
+                            double dx = x[3*j] - x[3*i], dy = x[3*j + 1] - x[3*i + 1];
+                            if (j == i || dx*dx + dy*dy >= range_sq) continue;
+                            if (pass == 1) neighbours[k] = j;
+                            k++;
+                        }
+                    }
+                }
+                if (pass == 0) start[i + 1] = k;
+            }
+            if (pass == 0) {
+                for(size_t i = 0; i < n; i++) {
+                    start[i + 1] += start[i];
+                }
+                neighbours.resize(start[n]);
+            }
+        }
+        builds++;
+    }
+};
+
+#endif
@@ -0,0 +1,133 @@
+#include <iostream>
+#include <fstream>
+#include <utility>
+#include <boost/numeric/odeint.hpp>
+#include <omp.h>
+#include "./cell_list.cc"
+#include "./random.cc"
+#include "./low_storage_rk.cc"
+#include "./memory.cc"
+#include "./observables.cc"
+#include "./run.cc"
+#include "./kernels.cc"
+using namespace std;
+using namespace boost::numeric::odeint;
+
+// swarmalators with finite-range coupling: pairs further apart than cutoff do not interact
+// neighbours come from Verlet lists built over a cell list, rebuilt once a point has moved
+// more than skin / 2, so a right-hand side evaluation costs O(n * neighbours)
+struct swarm_local {
+    const size_t n;
+    vector<double> omega;
+    double J, K, omega0, cutoff;
+    bool repulsion;
+    // rebuilt lazily from inside the const update function
+    mutable NeighbourList list;
+    // neighbour loop specialized for J, K, omega and repulsion, chosen once in the constructor
+    typedef void (swarm_local::*kernel_type)(const vector<double> &, vector<double> &) const;
+    kernel_type kernel;
+
+    swarm_local(const size_t n_, double J_, double K_, double cutoff_, double skin_, const vector<double> &omega_,
+                bool repulsion_ = true):
+        n(n_), omega(omega_), J(J_), K(K_), omega0(omega_[0]), cutoff(cutoff_), repulsion(repulsion_),
+        list(cutoff_, skin_), kernel(select_kernel<swarm_local>(J_, K_, is_heterogeneous(omega_), repulsion_)) {}
+
+    void operator()(const vector<double> &x, vector<double> &dxdt, double t) const {
+        std::fill(dxdt.begin(), dxdt.end(), 0.);
+        accumulate(x, dxdt, t);
+    }
+
+    // add time derivatives onto dxdt, used directly by the low-storage integrator
+    void accumulate(const vector<double> &x, vector<double> &dxdt, double t) const {
+        (this->*kernel)(x, dxdt);
+    }
+
+    template<class M>
+    void accumulate_model(const vector<double> &x, vector<double> &dxdt) const {
+        if (list.stale(x, n)) list.build(x, n);
+        const double cutoff_sq = cutoff * cutoff;
+
+        // each point gathers from its own list, so every thread writes only its own derivatives
+#pragma omp parallel for schedule(dynamic, 64)
+        for(size_t i = 0; i < n; i++) {
+            size_t xi = 3*i, yi = 3*i + 1, ti = 3*i + 2;
+            const size_t *nb = list.neighbours.data() + list.start[i];
+            const size_t count = list.start[i + 1] - list.start[i];
+            const double px = x[xi], py = x[yi], pt = x[ti];
+            double fx = 0., fy = 0., ft = 0.;
+
+            // branch-free over the list, pairs in the skin beyond cutoff are masked to zero
+#pragma omp simd reduction(+:fx,fy,ft)
+            for(size_t k = 0; k < count; k++) {
+                size_t j = nb[k];
+                double dx = x[3*j] - px,
+                       dy = x[3*j + 1] - py,
+                       distance_sq = (dx*dx+dy*dy),
+                       inside = distance_sq < cutoff_sq ? 1. : 0.,
+                       xdot_contrib, tdot;
+                interaction<M>(dx, dy, x[3*j + 2] - pt, J, K, xdot_contrib, tdot);
+
+                fx += inside * xdot_contrib * dx;
+                fy += inside * xdot_contrib * dy;
+                if (M::k_term) ft += inside * tdot;
+            }
+
+            dxdt[xi] += fx / n;
+            dxdt[yi] += fy / n;
+            dxdt[ti] += natural_frequency<M>(omega, omega0, i) + ft / n;
+        }
+    }
+};
+
+void print_points(const size_t n, const vector<double> &x, bool final) {
+    ofstream file;
+    file.open(final ? "final.csv" : "init.csv");
+    for(size_t i = 0; i < n; i++) {
+        file << x[3*i] << "," << x[3*i + 1] << "," << x[3*i + 2] << endl;
+    }
+    file.close();
+}
+
+int main(int argc, char **argv) {
+    const size_t n = stoi(argv[2]);
+    const double dt = 0.1;
+
+    // (0.1, 1) uniform
+    // (0.1, -1) random
+    // (1, 0) continuous rainbow
+    // (1, -0.1) discrete rainbow
+    // (1, -0.75) mixed rainbow
+    const double J = 1, K = -0.1;
+    // coupling range, optional third argument, and Verlet skin
+    const double cutoff = argc > 3 ? stod(argv[3]) : 0.5;
+    const double skin = 0.25 * cutoff;
+
+    // initial condition shape and seed, see random.cc
+    const Shape shape = DISK;
+    const uint64_t seed = 6;
+    // natural frequencies, see random.cc - IDENTICAL gives omega_i = 0.1 for all points
+    const Frequencies frequencies = IDENTICAL;
+    const double omega_mean = 0.1, omega_width = 0.;
+    // integrator, in-situ observables and early stopping, see RunOptions in run.cc
+    const RunOptions options;
+
+    // number of parallel threads
+    omp_set_num_threads(stoi(argv[1]));
+
+    vector<double> x(3*n);
+    initial_conditions(x, seed, shape, 0, n);
+
+    print_points(n, x, false);
+
+    vector<double> omega(n);
+    natural_frequencies(omega, seed, frequencies, omega_mean, omega_width, 0, n);
+
+    swarm_local group(n, J, K, cutoff, skin, omega);
+    run(group, x, dt, options);
+    printf("Neighbour list builds: %zu, mean neighbours: %.1f\n", group.list.builds,
+           (double) group.list.neighbours.size() / n);
+    print_memory(n);
+    print_points(n, x, true);
+
+    return 0;
+}
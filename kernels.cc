@@ -0,0 +1,69 @@
+#ifndef KERNELS_CC
+#define KERNELS_CC
+
+#include <cmath>
+#include <vector>
+
+// compile-time traits of the swarmalator model, so that the hot loops carry no dead arithmetic
+// J_TERM: J != 0, phase-dependent attraction (J = 0 drops the cos of every pair)
+// K_TERM: K != 0, phase coupling (K = 0, e.g. the continuous rainbow, drops the sin of every pair)
+// HETEROGENEOUS: natural frequencies differ per point, otherwise a single omega is added
+// REPULSION: short-range 1/|r| repulsion between points
+template<bool J_TERM, bool K_TERM, bool HETEROGENEOUS, bool REPULSION>
+struct Model {
+    static const bool j_term = J_TERM, k_term = K_TERM, heterogeneous = HETEROGENEOUS, repulsion = REPULSION;
+};
+
+// pair interaction of the swarmalator model for separation (dx, dy) and phase difference dth,
+// before the 1/n normalization: position derivative is xdot_contrib * (dx, dy), phase derivative tdot
+// coherence scales the J and K terms of a tree centroid, and is 1 for single points
+template<class M>
+inline void interaction(double dx, double dy, double dth, double J, double K,
+                        double &xdot_contrib, double &tdot, double coherence = 1.) {
+    double distance_sq = (dx*dx+dy*dy),
+           distance = sqrt(distance_sq);
+    xdot_contrib = (M::j_term ? 1. + J*coherence*cos(dth) : 1.)/distance;
+    if (M::repulsion) xdot_contrib -= 1./distance_sq;
+    tdot = M::k_term ? K*coherence*sin(dth)/distance : 0.;
+}
+
+// natural frequency of point i, omega0 when all points share it
+template<class M>
+inline double natural_frequency(const std::vector<double> &omega, double omega0, size_t i) {
+    return M::heterogeneous ? omega[i] : omega0;
+}
+
+// picks the specialization of Solver::accumulate_model for the runtime parameters, once per run
+template<class Solver, bool J_TERM, bool K_TERM, bool HETEROGENEOUS>
+typename Solver::kernel_type select_kernel(bool repulsion) {
+    if (repulsion) return &Solver::template accumulate_model< Model<J_TERM, K_TERM, HETEROGENEOUS, true> >;
+    return &Solver::template accumulate_model< Model<J_TERM, K_TERM, HETEROGENEOUS, false> >;
+}
+
+template<class Solver, bool J_TERM, bool K_TERM>
+typename Solver::kernel_type select_kernel(bool heterogeneous, bool repulsion) {
+    if (heterogeneous) return select_kernel<Solver, J_TERM, K_TERM, true>(repulsion);
+    return select_kernel<Solver, J_TERM, K_TERM, false>(repulsion);
+}
+
+template<class Solver, bool J_TERM>
+typename Solver::kernel_type select_kernel(double K, bool heterogeneous, bool repulsion) {
+    if (K != 0) return select_kernel<Solver, J_TERM, true>(heterogeneous, repulsion);
+    return select_kernel<Solver, J_TERM, false>(heterogeneous, repulsion);
+}
+
+template<class Solver>
+typename Solver::kernel_type select_kernel(double J, double K, bool heterogeneous, bool repulsion) {
+    if (J != 0) return select_kernel<Solver, true>(K, heterogeneous, repulsion);
+    return select_kernel<Solver, false>(K, heterogeneous, repulsion);
+}
+
+// true if omega holds more than one distinct frequency
+bool is_heterogeneous(const std::vector<double> &omega) {
+    for(size_t i = 1; i < omega.size(); i++) {
+        if (omega[i] != omega[0]) return true;
+    }
+    return false;
+}
+
+#endif
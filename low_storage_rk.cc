@@ -0,0 +1,83 @@
+#ifndef LOW_STORAGE_RK_CC
+#define LOW_STORAGE_RK_CC
+
+#include <boost/numeric/odeint.hpp>
+
+// fourth-order, five-stage 2N-storage Runge-Kutta method of Carpenter & Kennedy (1994)
+// in Williamson form, with dq kept divided by dt:
+//     dq = A_s dq + f(x, t + C_s dt),  x += B_s dt dq
+// only x and dq are state sized, against six state sized vectors held by odeint's runge_kutta4,
+// but its five stages cost five right-hand side evaluations per step against four, 25% more work
+// the system must provide accumulate(x, dxdt, t), which adds the right-hand side onto dxdt,
+// so that f is never stored on its own
+template<class State>
+class low_storage_rk4 {
+public:
+    typedef State state_type;
+    typedef State deriv_type;
+    typedef double value_type;
+    typedef double time_type;
+    typedef unsigned short order_type;
+    typedef boost::numeric::odeint::stepper_tag stepper_category;
+    typedef typename boost::numeric::odeint::algebra_dispatcher<State>::algebra_type algebra_type;
+    typedef boost::numeric::odeint::default_operations operations_type;
+
+    static order_type order() { return 4; }
+
+    template<class System>
+    void do_step(System system, State &x, double t, double dt) {
+        ignore_derivative ignore;
+        do_step(system, x, t, dt, ignore);
+    }
+
+    // as above, also handing x and f(x, t) to observe(x, dxdt, t) before x moves: A_0 = 0, so after
+    // the first stage dq is exactly f(x, t) and observers need neither an extra evaluation nor a register
+    template<class System, class Observer>
+    void do_step(System system, State &x, double t, double dt, Observer &observe) {
+        static const double A[5] = {0.,
+                                    -567301805773. / 1357537059087.,
+                                    -2404267990393. / 2016746695238.,
+                                    -3550918686646. / 2091501179385.,
+                                    -1275806237668. / 842570457699.};
+        static const double B[5] = {1432997174477. / 9575080441755.,
+                                    5161836677717. / 13612068292357.,
+                                    1720146321549. / 2090206949498.,
+                                    3134564353537. / 4481467310338.,
+                                    2277821191437. / 14882151754819.};
+        static const double C[5] = {0.,
+                                    1432997174477. / 9575080441755.,
+                                    2526269341429. / 6820363962896.,
+                                    2006345519317. / 3224310063776.,
+                                    2802321613138. / 2924317926251.};
+
+        if (!boost::numeric::odeint::same_size(dq, x)) boost::numeric::odeint::resize(dq, x);
+        typename boost::numeric::odeint::unwrap_reference<System>::type &sys = system;
+
+        for(size_t s = 0; s < 5; s++) {
+            algebra.for_each2(dq, dq, operations_type::scale_sum1<double>(A[s]));
+            sys.accumulate(x, dq, t + C[s]*dt);
+            if (s == 0) observe(x, dq, t);
+            algebra.for_each3(x, x, dq, operations_type::scale_sum2<double, double>(1., B[s]*dt));
+        }
+    }
+
+    // f(x, t) in the derivative register, for an observer after the last step
+    template<class System>
+    const State &derivative(System system, const State &x, double t) {
+        if (!boost::numeric::odeint::same_size(dq, x)) boost::numeric::odeint::resize(dq, x);
+        typename boost::numeric::odeint::unwrap_reference<System>::type &sys = system;
+        algebra.for_each2(dq, dq, operations_type::scale_sum1<double>(0.));
+        sys.accumulate(x, dq, t);
+        return dq;
+    }
+
+private:
+    struct ignore_derivative {
+        void operator()(const State &x, const State &dxdt, double t) {}
+    };
+
+    State dq;
+    algebra_type algebra;
+};
+
+#endif
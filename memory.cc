@@ -0,0 +1,29 @@
+#ifndef MEMORY_CC
+#define MEMORY_CC
+
+#include <cstdio>
+#include <cstring>
+
+// peak resident set size of this process in bytes, 0 if /proc is unavailable
+size_t peak_memory() {
+    FILE *status = fopen("/proc/self/status", "r");
+    if (status == NULL) return 0;
+    char line[256];
+    size_t kb = 0;
+    while (fgets(line, sizeof(line), status) != NULL) {
+        if (strncmp(line, "VmHWM:", 6) == 0) {
+            sscanf(line + 6, "%zu", &kb);
+            break;
+        }
+    }
+    fclose(status);
+    return kb * 1024;
+}
+
+// print peak memory in total and per particle held by this process
+void print_memory(const size_t n_local) {
+    size_t bytes = peak_memory();
+    printf("Peak memory: %.1f MB, %.1f bytes per particle\n", bytes / 1048576., (double) bytes / n_local);
+}
+
+#endif
@@ -4,47 +4,73 @@
 #include <boost/numeric/odeint.hpp>
 #include <boost/numeric/odeint/external/openmp/openmp.hpp>
 #include <boost/numeric/odeint/external/mpi/mpi.hpp>
+#include <boost/serialization/vector.hpp>
 #include <omp.h>
+#include "./random.cc"
+#include "./low_storage_rk.cc"
+#include "./memory.cc"
+#include "./observables.cc"
+#include "./run.cc"
+#include "./kernels.cc"
 
 using namespace std;
 using namespace boost::numeric::odeint;
 
-#pragma omp declare reduction(vec_add : std::vector<double> : \
-                              std::transform(omp_out.begin(), omp_out.end(), omp_in.begin(), omp_out.begin(), std::plus<double>())) \
-                    initializer(omp_priv = omp_orig)
+// Points [first, second) of processor rank, the first n % size processors take one extra point as in odeint's split
+std::pair<size_t, size_t> block(const size_t n, const boost::mpi::communicator &world, int rank) {
+    return detail::split_offsets(n, rank, world.size());
+}
 
 struct swarm {
+    // Natural frequencies of this processor's points
     vector<double> omega;
     const size_t n;
-    double J, K;
+    double J, K, omega0;
+    bool repulsion;
+    // Inner loop specialized for J, K, omega and repulsion, chosen once in the constructor
+    typedef void (swarm::*kernel_type)(const vector<double> &, vector<double> &, size_t) const;
+    kernel_type kernel;
 
-    swarm(const size_t n_, double J_, double K_)
-        : n(n_), omega(n_, 0.1), J(J_), K(K_) {}
+    swarm(const size_t n_, double J_, double K_, const vector<double> &omega_, bool repulsion_ = true)
+        : n(n_), omega(omega_), J(J_), K(K_), omega0(omega_[0]), repulsion(repulsion_),
+          kernel(select_kernel<swarm>(J_, K_, is_heterogeneous(omega_), repulsion_)) {}
 
     // Update function
     void operator()(const mpi_state< vector<double> > &x, mpi_state< vector<double> > &dxdt, double t) const {
+        std::fill(dxdt().begin(), dxdt().end(), 0.);
+        accumulate(x, dxdt, t);
+    }
+
+    // Add position and phase velocities of this processor's points onto dxdt, used directly by the low-storage integrator
+    void accumulate(const mpi_state< vector<double> > &x, mpi_state< vector<double> > &dxdt, double t) const {
         assert(x().size() % 3 == 0);
         vector<double> xx(3*n);
-        size_t start = 3*n / x.world.size() * x.world.rank();
+        size_t start = 3*block(n, x.world, x.world.rank()).first;
         // Get all other positions and phases
         copy(x().begin(), x().end(), xx.begin() + start);
         for(size_t i = 1; i < x.world.size(); i++) {
-            int in_rank = (x.world.rank() - i) % x.world.size(), out_rank = (x.world.rank() + i) % x.world.size();
+            int in_rank = (x.world.rank() + x.world.size() - i) % x.world.size(), out_rank = (x.world.rank() + i) % x.world.size();
             vector<double> temp;
-            x.world.send(out_rank, 0, x());
+            // Non-blocking send, so that processors all sending at once cannot deadlock on large blocks
+            boost::mpi::request sent = x.world.isend(out_rank, 0, x());
             x.world.recv(in_rank, 0, temp);
-            copy(temp.begin(), temp.end(), xx.begin() + 3*n / x.world.size() * in_rank);
+            sent.wait();
+            copy(temp.begin(), temp.end(), xx.begin() + 3*block(n, x.world, in_rank).first);
         }
-        vector<double> dxxdt = dxdt();
-        // Initialize position and phase velocities - omega_i are all set to 0.1
+        (this->*kernel)(xx, dxdt(), start);
+    }
+
+    // Add velocities of the points starting at start in the gathered state xx onto dxxdt
+    template<class M>
+    void accumulate_model(const vector<double> &xx, vector<double> &dxxdt, size_t start) const {
+        // Natural frequencies
 #pragma omp parallel for
-        for(size_t i = 0; i < dxdt().size() / 3; i++) {
-            dxxdt[3*i] = 0.;
-            dxxdt[3*i + 1] = 0.;
-            dxxdt[3*i + 2] = 0.1;
+        for(size_t i = 0; i < dxxdt.size() / 3; i++) {
+            dxxdt[3*i + 2] += natural_frequency<M>(omega, omega0, i);
         }
         // Calculate position and phase velocities by iterating over all points
-#pragma omp parallel for reduction(vec_add:dxxdt) schedule(dynamic)
+        // Each point only updates its own derivatives, so no per-thread copy of dxdt is needed
+#pragma omp parallel for schedule(dynamic)
         for(size_t i = 0; i < dxxdt.size() / 3; i++) {
             size_t xi = start + 3*i, yi = start + 3*i + 1, ti = start + 3*i + 2;
             for(size_t j = 0; j < n; j++) {
@@ -52,24 +78,40 @@ struct swarm {
                     int xj = 3*j, yj = 3*j + 1, tj = 3*j + 2;
                     double dx = xx[xj] - xx[xi],
                            dy = xx[yj] - xx[yi],
-                           dth = xx[tj] - xx[ti],
-                           distance_sq = (dx*dx+dy*dy),
-                           distance = sqrt(distance_sq),
-                           xdot_contrib = (((1. + J*cos(dth))/distance - 1./distance_sq))/n,
-                           tdot = K/n*sin(dth)/distance,
-                           xdot = xdot_contrib * dx,
-                           ydot = xdot_contrib * dy;
-
-                        dxxdt[xi - start] += xdot;
-                        dxxdt[yi - start] += ydot;
-                        dxxdt[ti - start] += tdot;
+                           xdot_contrib, tdot;
+                    interaction<M>(dx, dy, xx[tj] - xx[ti], J, K, xdot_contrib, tdot);
+
+                        dxxdt[xi - start] += xdot_contrib/n * dx;
+                        dxxdt[yi - start] += xdot_contrib/n * dy;
+                        if (M::k_term) dxxdt[ti - start] += tdot/n;
                 }
             }
         }
-#pragma omp parallel for
-        for(size_t i = 0; i < dxxdt.size(); i++) {
-            dxdt()[i] = dxxdt[i];
+    }
+};
+
+// In-situ observables every few steps, partial sums of each processor combined with one allreduce
+// Only processor 0 writes observables.csv, all processors agree on convergence
+// dxdt is this processor's block of the derivative the stepper already computed (run.cc), so sampling
+// adds only the allreduce, no ring exchange of its own
+struct insitu_mpi_observer {
+    ofstream &file;
+    size_t every, steps;
+    Convergence convergence;
+
+    insitu_mpi_observer(ofstream &file_, size_t every_, double tol_):
+        file(file_), every(every_), steps(0), convergence(tol_) {}
+
+    void operator()(const mpi_state< vector<double> > &x, const mpi_state< vector<double> > &dxdt, double t) {
+        if (every == 0 || steps++ % every != 0) return;
+        double local[N_SUMS], sums[N_SUMS];
+        local_sums(x(), dxdt(), local);
+        boost::mpi::all_reduce(x.world, local, N_SUMS, sums, std::plus<double>());
+        Observables o = observables(sums);
+        if (x.world.rank() == 0) {
+            print_observables(file, t, o);
         }
+        if (convergence.update(o)) throw converged(t);
     }
 };
 
@@ -90,7 +132,6 @@ int main(int argc, char **argv) {
     // Number of parallel threads
     omp_set_num_threads(stoi(argv[1]));
 
-    srand(time(NULL));
     // Number of points in swarm
     const size_t n = stoi(argv[2]);
 
@@ -100,32 +141,41 @@ int main(int argc, char **argv) {
     // (1, -0.1) discrete rainbow
     // (1, -0.75) mixed rainbow
     const double J = 1., K = -0.1, dt = 0.1;
+    // Initial condition shape and seed, see random.cc
+    const Shape shape = DISK;
+    const uint64_t seed = 6;
+    // Natural frequencies, see random.cc - IDENTICAL gives omega_i = 0.1 for all points
+    const Frequencies frequencies = IDENTICAL;
+    const double omega_mean = 0.1, omega_width = 0.;
+    // Integrator, in-situ observables and early stopping, see RunOptions in run.cc
+    const RunOptions options;
     vector<double> x(3*n);
 
-    // Instantiate points in a circle with random positions and phases
-    if (world.rank() == 0) {
-#pragma omp parallel for
-        for(size_t i = 0; i < n; i++) {
-            double r = ((double) rand())/((double) RAND_MAX)*1.;
-            double theta = ((double) rand())/((double) RAND_MAX)*2.*M_PI;
-            x[3*i] = r*cos(theta);
-            x[3*i + 1] = r*sin(theta);
-            x[3*i + 2] = ((double) rand())/((double) RAND_MAX)*2.*M_PI;
-        }
+    // Each processor draws its own block of points, no communication needed
+    mpi_state< vector<double> > x_split(world);
+    size_t begin = block(n, world, world.rank()).first, end = block(n, world, world.rank()).second;
+    x_split().resize(3*(end - begin));
+    initial_conditions(x_split(), seed, shape, begin, end);
 
+    unsplit(x_split, x);
+    if (world.rank() == 0) {
         print_points(n, x, false);
     }
 
-    // Each processor gets own data
-    mpi_state< vector<double> > x_split(world);
-    split(x, x_split);
+    vector<double> omega(end - begin);
+    natural_frequencies(omega, seed, frequencies, omega_mean, omega_width, begin, end);
 
-    swarm group(n, J, K);
-    double t0 = omp_get_wtime();
+    swarm group(n, J, K, omega);
     // Pass to boost library integrator
-    integrate_const(runge_kutta4< mpi_state< vector<double> > >(), boost::ref(group), x_split, 0., 50., dt);
+    ofstream observables_file;
+    if (world.rank() == 0 && options.observe_every > 0) {
+        observables_file.open("observables.csv");
+        print_observables_header(observables_file);
+    }
+    insitu_mpi_observer observer(observables_file, options.observe_every, options.converge_tol);
+    integrate_observed(group, x_split, dt, options, observer, world.rank() == 0);
     if (world.rank() == 0) {
-        printf("Time taken: %f\n", omp_get_wtime()-t0);
+        print_memory(end - begin);
     }
     unsplit(x_split, x);
     if (world.rank() == 0) {
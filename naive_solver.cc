@@ -4,30 +4,53 @@
 #include <boost/numeric/odeint.hpp>
 #include <boost/numeric/odeint/external/openmp/openmp.hpp>
 #include <omp.h>
+#include "./random.cc"
+#include "./low_storage_rk.cc"
+#include "./memory.cc"
+#include "./observables.cc"
+#include "./run.cc"
+#include "./kernels.cc"
 
 using namespace std;
 using namespace boost::numeric::odeint;
 
 #pragma omp declare reduction(vec_add : std::vector<double> : \
                               std::transform(omp_out.begin(), omp_out.end(), omp_in.begin(), omp_out.begin(), std::plus<double>())) \
-                    initializer(omp_priv = omp_orig)
+                    initializer(omp_priv = std::vector<double>(omp_orig.size(), 0.))
 
 struct swarm {
     vector<double> omega;
     const size_t n;
-    double J, K;
+    double J, K, omega0;
+    bool repulsion;
+    // Inner loop specialized for J, K, omega and repulsion, chosen once in the constructor
+    typedef void (swarm::*kernel_type)(const vector<double> &, vector<double> &) const;
+    kernel_type kernel;
 
-    swarm(const size_t n_, double J_, double K_)
-        : n(n_), omega(n_, 0.1), J(J_), K(K_) {}
+    swarm(const size_t n_, double J_, double K_, const vector<double> &omega_, bool repulsion_ = true)
+        : n(n_), omega(omega_), J(J_), K(K_), omega0(omega_[0]), repulsion(repulsion_),
+          kernel(select_kernel<swarm>(J_, K_, is_heterogeneous(omega_), repulsion_)) {}
 
     // Update function
     void operator()(const vector<double> &x, vector<double> &dxdt, double t) const {
-    	// Initialize position and phase velocities - omega_i are all set to 0.1
+#pragma omp parallel for
+        for(size_t i = 0; i < 3*n; i++) {
+            dxdt[i] = 0.;
+        }
+        accumulate(x, dxdt, t);
+    }
+
+    // Add position and phase velocities onto dxdt, used directly by the low-storage integrator
+    void accumulate(const vector<double> &x, vector<double> &dxdt, double t) const {
+        (this->*kernel)(x, dxdt);
+    }
+
+    template<class M>
+    void accumulate_model(const vector<double> &x, vector<double> &dxdt) const {
+    	// Natural frequencies
 #pragma omp parallel for
         for(size_t i = 0; i < n; i++) {
-            dxdt[3*i] = 0.;
-            dxdt[3*i + 1] = 0.;
-            dxdt[3*i + 2] = 0.1;
+            dxdt[3*i + 2] += natural_frequency<M>(omega, omega0, i);
         }
         // Calculate position and phase velocities by iterating over all points
 #pragma omp parallel for reduction(vec_add:dxdt) schedule(dynamic)
@@ -35,22 +58,19 @@ struct swarm {
             size_t xi = 3*i, yi = 3*i + 1, ti = 3*i + 2;
             for(size_t j = 0; j < i; j++) {
                 int xj = 3*j, yj = 3*j + 1, tj = 3*j + 2;
-                double dx = x[xj] - x[xi],
-                       dy = x[yj] - x[yi],
-                       dth = x[tj] - x[ti],
-                       distance_sq = (dx*dx+dy*dy),
-                       distance = sqrt(distance_sq),
-                       xdot_contrib = (((1. + J*cos(dth))/distance - 1./distance_sq))/n,
-                       tdot = K/n*sin(dth)/distance,
-                       xdot = xdot_contrib * dx,
-                       ydot = xdot_contrib * dy;
+                double xdot_contrib, tdot;
+                interaction<M>(x[xj] - x[xi], x[yj] - x[yi], x[tj] - x[ti], J, K, xdot_contrib, tdot);
+                double xdot = xdot_contrib/n * (x[xj] - x[xi]),
+                       ydot = xdot_contrib/n * (x[yj] - x[yi]);
 
                 dxdt[xi] += xdot;
                 dxdt[yi] += ydot;
-                dxdt[ti] += tdot;
                 dxdt[xj] -= xdot;
                 dxdt[yj] -= ydot;
-                dxdt[tj] -= tdot;
+                if (M::k_term) {
+                    dxdt[ti] += tdot/n;
+                    dxdt[tj] -= tdot/n;
+                }
             }
         }
     }
@@ -66,7 +86,6 @@ void print_points(const size_t n, const vector<double> &x, bool final) {
 }
 
 int main(int argc, char **argv) {
-	srand(6);
 	// Number of points in swarm
     const size_t n = stoi(argv[2]);
 
@@ -76,26 +95,29 @@ int main(int argc, char **argv) {
     // (1, -0.1) discrete rainbow
     // (1, -0.75) mixed rainbow
     const double J = 1, K = -0.75, dt = 0.1;
-    vector<double> x(3*n);
+    // Initial condition shape and seed, see random.cc
+    const Shape shape = DISK;
+    const uint64_t seed = 6;
+    // Natural frequencies, see random.cc - IDENTICAL gives omega_i = 0.1 for all points
+    const Frequencies frequencies = IDENTICAL;
+    const double omega_mean = 0.1, omega_width = 0.;
+    // Integrator, in-situ observables and early stopping, see RunOptions in run.cc
+    const RunOptions options;
 
-#pragma omp parallel for
-    for(size_t i = 0; i < n; i++) {
-        double r = ((double) rand())/((double) RAND_MAX)*1.;
-        double theta = ((double) rand())/((double) RAND_MAX)*2.*M_PI;
-        x[3*i] = r*cos(theta);
-        x[3*i + 1] = r*sin(theta);
-        x[3*i + 2] = ((double) rand())/((double) RAND_MAX)*2.*M_PI;
-    }
+    // Number of parallel threads
+    omp_set_num_threads(stoi(argv[1]));
+
+    vector<double> x(3*n);
+    initial_conditions(x, seed, shape, 0, n);
 
     print_points(n, x, false);
 
-    // Number of parallel threads
-    omp_set_num_threads(stoi(argv[1]));
+    vector<double> omega(n);
+    natural_frequencies(omega, seed, frequencies, omega_mean, omega_width, 0, n);
 
-    swarm group(n, J, K);
-    double t0 = omp_get_wtime();
+    swarm group(n, J, K, omega);
     // Pass to boost library integrator
-    integrate_const(runge_kutta4< vector<double> >(), boost::ref(group), x, 0., 50., dt);
-    printf("Time taken: %f\n", omp_get_wtime()-t0);
+    run(group, x, dt, options);
+    print_memory(n);
     print_points(n, x, true);
 }
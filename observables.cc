@@ -0,0 +1,118 @@
+#ifndef OBSERVABLES_CC
+#define OBSERVABLES_CC
+
+#include <cmath>
+#include <vector>
+#include <fstream>
+#include <algorithm>
+
+// in-situ order parameters of the swarmalator state, with phi the spatial angle and theta the phase
+// S_plus, S_minus: |<e^{i(phi + theta)}>|, |<e^{i(phi - theta)}>|, the rainbow order parameters
+// R: Kuramoto order parameter |<e^{i theta}>|
+// radius: mean distance from the origin
+// speed, speed_sd: mean and standard deviation of |dx/dt|
+struct Observables {
+    double S_plus, S_minus, R, radius, speed, speed_sd;
+
+    Observables(double S_plus = 0, double S_minus = 0, double R = 0, double radius = 0, double speed = 0, double speed_sd = 0):
+        S_plus(S_plus), S_minus(S_minus), R(R), radius(radius), speed(speed), speed_sd(speed_sd) {}
+};
+
+// number of partial sums behind Observables, combined by plain addition across threads and ranks
+const int N_SUMS = 10;
+
+// partial sums over the points held in x, with their time derivatives in dxdt, in a single fused pass
+// cos, sin of phi + theta, phi - theta, theta, then r, |v|, |v|^2, count
+void local_sums(const std::vector<double> &x, const std::vector<double> &dxdt, double sums[N_SUMS]) {
+    double pc = 0, ps = 0, mc = 0, ms = 0, tc = 0, ts = 0, r_sum = 0, v_sum = 0, v2_sum = 0;
+    const size_t count = x.size() / 3;
+#pragma omp parallel for reduction(+:pc,ps,mc,ms,tc,ts,r_sum,v_sum,v2_sum)
+    for(size_t i = 0; i < count; i++) {
+        size_t xi = 3*i, yi = 3*i + 1, ti = 3*i + 2;
+        double r = sqrt(x[xi]*x[xi] + x[yi]*x[yi]),
+               cp = r > 0 ? x[xi]/r : 1., sp = r > 0 ? x[yi]/r : 0.,
+               ct = cos(x[ti]), st = sin(x[ti]),
+               v2 = dxdt[xi]*dxdt[xi] + dxdt[yi]*dxdt[yi];
+        pc += cp*ct - sp*st;
+        ps += sp*ct + cp*st;
+        mc += cp*ct + sp*st;
+        ms += sp*ct - cp*st;
+        tc += ct;
+        ts += st;
+        r_sum += r;
+        v_sum += sqrt(v2);
+        v2_sum += v2;
+    }
+    sums[0] = pc; sums[1] = ps; sums[2] = mc; sums[3] = ms; sums[4] = tc; sums[5] = ts;
+    sums[6] = r_sum; sums[7] = v_sum; sums[8] = v2_sum; sums[9] = count;
+}
+
+// observables from sums combined over all points
+Observables observables(const double sums[N_SUMS]) {
+    double n = sums[9], speed = sums[7] / n;
+    return Observables(sqrt(sums[0]*sums[0] + sums[1]*sums[1]) / n,
+                       sqrt(sums[2]*sums[2] + sums[3]*sums[3]) / n,
+                       sqrt(sums[4]*sums[4] + sums[5]*sums[5]) / n,
+                       sums[6] / n, speed, sqrt(std::max(0., sums[8] / n - speed*speed)));
+}
+
+void print_observables_header(std::ofstream &file) {
+    file << "t,S_plus,S_minus,R,radius,speed,speed_sd" << std::endl;
+}
+
+void print_observables(std::ofstream &file, double t, const Observables &o) {
+    file << t << "," << o.S_plus << "," << o.S_minus << "," << o.R << ","
+         << o.radius << "," << o.speed << "," << o.speed_sd << std::endl;
+}
+
+// thrown from an observer to end the integration once the state has converged
+struct converged {
+    double t;
+    converged(double t): t(t) {}
+};
+
+// flags convergence once S_plus, S_minus, R and radius have each moved less than tol
+// over patience consecutive samples, tol = 0 never converges
+struct Convergence {
+    double tol;
+    size_t patience, still;
+    bool first;
+    Observables last;
+
+    Convergence(double tol = 0, size_t patience = 5):
+        tol(tol), patience(patience), still(0), first(true) {}
+
+    bool update(const Observables &o) {
+        bool steady = !first &&
+                      fabs(o.S_plus - last.S_plus) < tol && fabs(o.S_minus - last.S_minus) < tol &&
+                      fabs(o.R - last.R) < tol && fabs(o.radius - last.radius) < tol;
+        still = steady ? still + 1 : 0;
+        first = false;
+        last = o;
+        return tol > 0 && still >= patience;
+    }
+};
+
+// observer computing the observables every few steps of a shared-memory solver, writing them to
+// file and stopping the integration once they converge, every = 0 never samples
+// dxdt is the derivative the stepper has already computed at x (run.cc), so a sample is a single
+// reduction over the state and its derivative, with no evaluation of the system of its own
+struct insitu_observer {
+    std::ofstream &file;
+    size_t every, steps;
+    Convergence convergence;
+
+    insitu_observer(std::ofstream &file_, size_t every_, double tol_):
+        file(file_), every(every_), steps(0), convergence(tol_) {}
+
+    void operator()(const std::vector<double> &x, const std::vector<double> &dxdt, double t) {
+        if (every == 0 || steps++ % every != 0) return;
+        double sums[N_SUMS];
+        local_sums(x, dxdt, sums);
+        Observables o = observables(sums);
+        print_observables(file, t, o);
+        if (convergence.update(o)) throw converged(t);
+    }
+};
+
+#endif
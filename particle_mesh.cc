@@ -0,0 +1,263 @@
+#ifndef PARTICLE_MESH_CC
+#define PARTICLE_MESH_CC
+
+#include <cmath>
+#include <cassert>
+#include <vector>
+#include <complex>
+#include <algorithm>
+#include <omp.h>
+#include "./cell_list.cc"
+
+typedef std::complex<double> cplx;
+
+bool power_of_two(const size_t n) {
+    return n > 0 && (n & (n - 1)) == 0;
+}
+
+// padded 2M x 2M complex grids held by a mesh: position kernel and density always, J kernel and sin
+// field with J, phase kernel with K, phase density with either, cos field with both (see ParticleMesh)
+size_t mesh_grids(bool j_term, bool k_term) {
+    return 2 + (j_term ? 2 : 0) + (k_term ? 1 : 0) + (j_term || k_term ? 1 : 0) + (j_term && k_term ? 1 : 0);
+}
+
+// bytes held by the grids of an M x M mesh
+double mesh_bytes(const size_t M, size_t grids) {
+    return (double) grids * sizeof(std::complex<double>) * 4. * M * M;
+}
+
+// smallest power-of-two grid side with at most points_per_cell points per cell of an M x M grid,
+// or the largest whose grids fit in budget bytes
+// the short-range pair sum of a split mesh covers about 200 split^2 / 4 cells around each point,
+// so choosing M from n this way keeps its cost linear in n, at a mesh of about n / points_per_cell cells
+size_t grid_for(const size_t n, double points_per_cell, double budget, size_t grids) {
+    size_t M = 16;
+    while ((double) n / ((double) M * M) > points_per_cell && mesh_bytes(2 * M, grids) <= budget) M *= 2;
+    return M;
+}
+
+// in-place iterative radix-2 FFT of length n, a power of two, unnormalized in both directions
+void fft(cplx *a, const size_t n, bool inverse) {
+    for(size_t i = 1, j = 0; i < n; i++) {
+        size_t bit = n >> 1;
+        for(; j & bit; bit >>= 1) j ^= bit;
+        j ^= bit;
+        if (i < j) std::swap(a[i], a[j]);
+    }
+    for(size_t len = 2; len <= n; len <<= 1) {
+        double angle = (inverse ? 2. : -2.) * M_PI / len;
+        cplx w_len(cos(angle), sin(angle));
+        for(size_t i = 0; i < n; i += len) {
+            cplx w(1.);
+            for(size_t k = 0; k < len / 2; k++) {
+                cplx u = a[i + k], v = a[i + k + len / 2] * w;
+                a[i + k] = u + v;
+                a[i + k + len / 2] = u - v;
+                w *= w_len;
+            }
+        }
+    }
+}
+
+// 2D FFT of an n x n row-major grid: rows in place, then columns through a per-thread buffer
+void fft2(std::vector<cplx> &a, const size_t n, bool inverse) {
+#pragma omp parallel
+    {
+#pragma omp for
+        for(size_t r = 0; r < n; r++) {
+            fft(&a[r * n], n, inverse);
+        }
+        std::vector<cplx> column(n);
+#pragma omp for
+        for(size_t c = 0; c < n; c++) {
+            for(size_t r = 0; r < n; r++) column[r] = a[r * n + c];
+            fft(&column[0], n, inverse);
+            for(size_t r = 0; r < n; r++) a[r * n + c] = column[r];
+        }
+    }
+}
+
+// particle-mesh evaluation of the swarmalator far field on an M x M grid over the points
+// mass and e^{i theta} = cos + i sin densities are deposited with cloud-in-cell and convolved, zero
+// padded to 2M x 2M, with the kernels of s = x - x_j, vectors packed as x + i y:
+//     rho * (-s/|s| + s/|s|^2)   position terms independent of phase
+//     cos * (-s/|s|)             J cos(theta_j - theta_i) position term, as cos theta_i cos * . + sin theta_i sin * .
+//     sin * (-s/|s|)
+//     c * (1/|s|)                K sin(theta_j - theta_i) phase term, through Im(e^{-i theta_i} .)
+// cos and sin share the transform of c, split by its symmetry, and the fields are transformed back in
+// place in the density grids where they fit
+// with split > 0 only the smooth long-range part of each kernel goes on the mesh, sigma = split * h:
+// the vector kernels times 1 - exp(-|s|^2 / sigma^2), which leaves them linear in s at the origin,
+// and 1/|s| times erf(|s| / sigma); the remainders, exp(-|s|^2 / sigma^2) and erfc(|s| / sigma)
+// times the kernels, vanish beyond a few sigma and are summed over pairs (P3M)
+// kernels and fields of terms the model lacks (J = 0, K = 0) are neither allocated, transformed nor convolved
+struct ParticleMesh {
+    size_t M, N;
+    double split, sigma;
+    bool j_term, k_term, repulsion;
+    // lower corner and spacing of the grid, and the extent the kernels were built for
+    double x0, y0, h, extent;
+    // kernel transforms, each only for the terms that use it
+    std::vector<cplx> g_rho, g_j, g_p;
+    // densities, their transforms, then in place the position field and the phase field (or without K
+    // the cos field), and the cos and sin fields where c cannot hold them, see mesh_grids
+    std::vector<cplx> rho, c, j_cos, j_sin;
+    // points sorted into cells of at least 4 h, for a deposit without write conflicts, at least
+    // 4 sigma wide so the short-range pair sum can use them as well
+    CellList cells;
+
+    ParticleMesh(size_t M = 128, double split = 0, bool j_term = true, bool k_term = true, bool repulsion = true):
+        M(M), N(2 * M), split(split), sigma(0), j_term(j_term), k_term(k_term), repulsion(repulsion),
+        x0(0), y0(0), h(0), extent(0) {
+        // fft only handles powers of two, and cloud-in-cell needs a margin of one cell on each side
+        assert(power_of_two(M) && M >= 4);
+    }
+
+    // place the grid over the points, rebuilding the kernels when the spacing has to change
+    // the grid is resized only when points leave it or shrink to under half of it
+    void place(const std::vector<double> &x, const size_t n) {
+        double lo_x = x[0], hi_x = x[0], lo_y = x[1], hi_y = x[1];
+#pragma omp parallel for reduction(min:lo_x,lo_y) reduction(max:hi_x,hi_y)
+        for(size_t i = 0; i < n; i++) {
+            lo_x = std::min(lo_x, x[3*i]);
+            hi_x = std::max(hi_x, x[3*i]);
+            lo_y = std::min(lo_y, x[3*i + 1]);
+            hi_y = std::max(hi_y, x[3*i + 1]);
+        }
+        double span = std::max(hi_x - lo_x, hi_y - lo_y);
+        if (span <= 0) span = 1.;
+        if (span > extent || 2 * span < extent) {
+            extent = 1.25 * span;
+            h = extent / (M - 2);
+            sigma = split * h;
+            kernels();
+        }
+        // centre the grid on the points, keeping one cell of margin for cloud-in-cell
+        x0 = 0.5 * (lo_x + hi_x) - 0.5 * (M - 1) * h;
+        y0 = 0.5 * (lo_y + hi_y) - 0.5 * (M - 1) * h;
+    }
+
+    void kernels() {
+        g_rho.assign(N * N, 0.);
+        g_j.assign(j_term ? N * N : 0, 0.);
+        g_p.assign(k_term ? N * N : 0, 0.);
+#pragma omp parallel for
+        for(size_t r = 0; r < N; r++) {
+            long b = r < M ? (long) r : (long) r - (long) N;
+            for(size_t q = 0; q < N; q++) {
+                long a = q < M ? (long) q : (long) q - (long) N;
+                double sx = a * h, sy = b * h, d = sqrt(sx*sx + sy*sy);
+                size_t k = r * N + q;
+                if (d == 0) {
+                    // odd kernels vanish at the origin, the smoothed 1/|s| tends to 2 / (sqrt(pi) sigma)
+                    if (k_term) g_p[k] = sigma > 0 ? 2. / (sqrt(M_PI) * sigma) : 0.;
+                    continue;
+                }
+                double mask = sigma > 0 ? 1. - exp(-d*d / (sigma*sigma)) : 1.,
+                       p_mask = sigma > 0 ? erf(d / sigma) : 1.,
+                       inv_d_sq = repulsion ? 1./(d*d) : 0.;
+                g_rho[k] = cplx((-sx/d + sx*inv_d_sq) * mask, (-sy/d + sy*inv_d_sq) * mask);
+                if (j_term) g_j[k] = cplx(-sx/d * mask, -sy/d * mask);
+                if (k_term) g_p[k] = p_mask / d;
+            }
+        }
+        fft2(g_rho, N, false);
+        if (j_term) fft2(g_j, N, false);
+        if (k_term) fft2(g_p, N, false);
+    }
+
+    // cloud-in-cell deposit of the n points of x straight into the padded grids
+    // a point writes the 2 x 2 grid points around it, so points in cells two apart never write the same
+    // grid point: the cells go in four colours by parity, cells of one colour in parallel, and each grid
+    // point sums its points in the same order for any thread count
+    void deposit(const std::vector<double> &x, const size_t n) {
+        const bool phase = j_term || k_term;
+        cells.build(x, n, std::max(4. * h, 4. * sigma), n);
+        rho.assign(N * N, 0.);
+        c.assign(phase ? N * N : 0, 0.);
+        const size_t half = (cells.side + 1) / 2;
+#pragma omp parallel
+        for(size_t colour = 0; colour < 4; colour++) {
+#pragma omp for schedule(dynamic, 16)
+            for(size_t b = 0; b < half * half; b++) {
+                size_t cx = 2 * (b % half) + colour % 2, cy = 2 * (b / half) + colour / 2;
+                if (cx >= cells.side || cy >= cells.side) continue;
+                size_t cell = cy * cells.side + cx;
+                for(size_t s = cells.start[cell]; s < cells.start[cell + 1]; s++) {
+                    size_t i = cells.order[s];
+                    double u = (x[3*i] - x0) / h, v = (x[3*i + 1] - y0) / h;
+                    size_t q = (size_t) u, r = (size_t) v;
+                    double wu = u - q, wv = v - r;
+                    double w[4] = {(1 - wu) * (1 - wv), wu * (1 - wv), (1 - wu) * wv, wu * wv};
+                    size_t k[4] = {r * N + q, r * N + q + 1, (r + 1) * N + q, (r + 1) * N + q + 1};
+                    cplx e = phase ? cplx(cos(x[3*i + 2]), sin(x[3*i + 2])) : 0.;
+                    for(int t = 0; t < 4; t++) {
+                        rho[k[t]] += w[t];
+                        if (phase) c[k[t]] += w[t] * e;
+                    }
+                }
+            }
+        }
+    }
+
+    // convolve the deposited densities with the kernels
+    void solve() {
+        fft2(rho, N, false);
+        if (j_term || k_term) fft2(c, N, false);
+        j_cos.resize(j_term && k_term ? N * N : 0);
+        j_sin.resize(j_term ? N * N : 0);
+        // without K the cos field goes in place of the phase density
+        std::vector<cplx> &cos_field = k_term ? j_cos : c;
+        const double norm = 1. / ((double) N * N);
+#pragma omp parallel for
+        for(size_t r = 0; r < N; r++) {
+            for(size_t q = 0; q < N; q++) {
+                size_t k = r * N + q;
+                rho[k] *= g_rho[k] * norm;
+                if (!j_term) {
+                    if (k_term) c[k] *= g_p[k] * norm;
+                    continue;
+                }
+                // the cos and sin densities are real, so their transforms at k and -k are the even and odd
+                // parts of that of c, C(k) = COS(k) + i SIN(k) and conj(C(-k)) = COS(k) - i SIN(k);
+                // each pair is done once, reading both before writing either
+                size_t m = ((N - r) % N) * N + (N - q) % N;
+                if (m < k) continue;
+                const size_t at[2] = {k, m};
+                const cplx c_k = c[k], c_m = c[m], own[2] = {c_k, c_m}, other[2] = {c_m, c_k};
+                for(int s = 0; s < 2; s++) {
+                    size_t a = at[s];
+                    cplx cos_a = 0.5 * (own[s] + conj(other[s])), sin_a = cplx(0, -0.5) * (own[s] - conj(other[s]));
+                    if (k_term) c[a] = own[s] * g_p[a] * norm;
+                    cos_field[a] = cos_a * g_j[a] * norm;
+                    j_sin[a] = sin_a * g_j[a] * norm;
+                }
+            }
+        }
+        fft2(rho, N, true);
+        if (j_term || k_term) fft2(c, N, true);
+        if (j_term && k_term) fft2(j_cos, N, true);
+        if (j_term) fft2(j_sin, N, true);
+    }
+
+    // cloud-in-cell interpolation of the fields to point (px, py), positions as x + i y
+    void interpolate(double px, double py, cplx &rho_field, cplx &cos_field, cplx &sin_field, cplx &p_field) const {
+        double u = (px - x0) / h, v = (py - y0) / h;
+        size_t q = (size_t) u, r = (size_t) v;
+        double wu = u - q, wv = v - r;
+        double w[4] = {(1 - wu) * (1 - wv), wu * (1 - wv), (1 - wu) * wv, wu * wv};
+        size_t k[4] = {r * N + q, r * N + q + 1, (r + 1) * N + q, (r + 1) * N + q + 1};
+        const std::vector<cplx> &j_cos_field = k_term ? j_cos : c;
+        rho_field = cos_field = sin_field = p_field = 0.;
+        for(int s = 0; s < 4; s++) {
+            rho_field += w[s] * rho[k[s]];
+            if (j_term) {
+                cos_field += w[s] * j_cos_field[k[s]];
+                sin_field += w[s] * j_sin[k[s]];
+            }
+            if (k_term) p_field += w[s] * c[k[s]];
+        }
+    }
+};
+
+#endif
@@ -0,0 +1,178 @@
+#include <iostream>
+#include <fstream>
+#include <utility>
+#include <boost/numeric/odeint.hpp>
+#include <omp.h>
+#include "./particle_mesh.cc"
+#include "./random.cc"
+#include "./low_storage_rk.cc"
+#include "./memory.cc"
+#include "./observables.cc"
+#include "./run.cc"
+#include "./kernels.cc"
+using namespace std;
+using namespace boost::numeric::odeint;
+
+// swarmalators with the all-to-all field from a particle mesh (particle_mesh.cc), cost set by the
+// grid size rather than an opening angle
+// with split > 0 the mesh carries the smoothed kernels and the short-range remainder is summed
+// exactly over pairs closer than 4 sigma, found with the cell list the mesh deposited from
+struct swarm_particle_mesh {
+    const size_t n;
+    vector<double> omega;
+    double J, K, omega0;
+    bool repulsion;
+    // grids and cell list are reused between right-hand side evaluations
+    mutable ParticleMesh mesh;
+    // interpolation and short-range loop specialized for J, K, omega and repulsion, chosen once in the constructor
+    typedef void (swarm_particle_mesh::*kernel_type)(const vector<double> &, vector<double> &) const;
+    kernel_type kernel;
+
+    swarm_particle_mesh(const size_t n_, double J_, double K_, size_t grid_, double split_, const vector<double> &omega_,
+                        bool repulsion_ = true):
+        n(n_), omega(omega_), J(J_), K(K_), omega0(omega_[0]), repulsion(repulsion_),
+        mesh(grid_, split_, J_ != 0, K_ != 0, repulsion_),
+        kernel(select_kernel<swarm_particle_mesh>(J_, K_, is_heterogeneous(omega_), repulsion_)) {}
+
+    void operator()(const vector<double> &x, vector<double> &dxdt, double t) const {
+        std::fill(dxdt.begin(), dxdt.end(), 0.);
+        accumulate(x, dxdt, t);
+    }
+
+    // add time derivatives onto dxdt, used directly by the low-storage integrator
+    void accumulate(const vector<double> &x, vector<double> &dxdt, double t) const {
+        (this->*kernel)(x, dxdt);
+    }
+
+    template<class M>
+    void accumulate_model(const vector<double> &x, vector<double> &dxdt) const {
+        mesh.place(x, n);
+        mesh.deposit(x, n);
+        mesh.solve();
+
+        const double sigma = mesh.sigma, cutoff = 4. * sigma, cutoff_sq = cutoff * cutoff;
+        const CellList &cells = mesh.cells;
+
+#pragma omp parallel for schedule(dynamic, 64)
+        for(size_t i = 0; i < n; i++) {
+            size_t xi = 3*i, yi = 3*i + 1, ti = 3*i + 2;
+            double ct = cos(x[ti]), st = sin(x[ti]);
+            cplx f_rho, f_cos, f_sin, f_p;
+            mesh.interpolate(x[xi], x[yi], f_rho, f_cos, f_sin, f_p);
+            // cos(theta_j - theta_i) = cos theta_i cos theta_j + sin theta_i sin theta_j, and
+            // Im(e^{-i theta_i} z) recovers the sin of the phase differences
+            double fx = f_rho.real(), fy = f_rho.imag(), ft = 0.;
+            if (M::j_term) {
+                fx += J * (ct * f_cos.real() + st * f_sin.real());
+                fy += J * (ct * f_cos.imag() + st * f_sin.imag());
+            }
+            if (M::k_term) ft += K * (ct * f_p.imag() - st * f_p.real());
+
+            if (sigma > 0) {
+                // short-range correction, the remainder of the kernels over the 3 x 3 neighbouring cells
+                size_t c = cells.cell[i], cx = c % cells.side, cy = c / cells.side;
+                size_t x_lo = cx > 0 ? cx - 1 : 0, x_hi = std::min(cells.side - 1, cx + 1);
+                size_t y_lo = cy > 0 ? cy - 1 : 0, y_hi = std::min(cells.side - 1, cy + 1);
+                for(size_t ny = y_lo; ny <= y_hi; ny++) {
+                    for(size_t nx = x_lo; nx <= x_hi; nx++) {
+                        size_t nc = ny * cells.side + nx;
+                        for(size_t s = cells.start[nc]; s < cells.start[nc + 1]; s++) {
+                            size_t j = cells.order[s];
+                            int xj = 3*j, yj = 3*j + 1, tj = 3*j + 2;
+                            double dx = x[xj] - x[xi],
+                                   dy = x[yj] - x[yi],
+                                   distance_sq = (dx*dx+dy*dy);
+                            if (j == i || distance_sq >= cutoff_sq) continue;
+                            double mask = exp(-distance_sq / (sigma*sigma)),
+                                   xdot_contrib, tdot;
+                            interaction<M>(dx, dy, x[tj] - x[ti], J, K, xdot_contrib, tdot);
+
+                            fx += xdot_contrib * mask * dx;
+                            fy += xdot_contrib * mask * dy;
+                            if (M::k_term) ft += tdot * erfc(sqrt(distance_sq) / sigma);
+                        }
+                    }
+                }
+            }
+
+            dxdt[xi] += fx / n;
+            dxdt[yi] += fy / n;
+            dxdt[ti] += natural_frequency<M>(omega, omega0, i) + ft / n;
+        }
+    }
+};
+
+void print_points(const size_t n, const vector<double> &x, bool final) {
+    ofstream file;
+    file.open(final ? "final.csv" : "init.csv");
+    for(size_t i = 0; i < n; i++) {
+        file << x[3*i] << "," << x[3*i + 1] << "," << x[3*i + 2] << endl;
+    }
+    file.close();
+}
+
+int main(int argc, char **argv) {
+    const size_t n = stoi(argv[2]);
+    const double dt = 0.1;
+
+    // (0.1, 1) uniform
+    // (0.1, -1) random
+    // (1, 0) continuous rainbow
+    // (1, -0.1) discrete rainbow
+    // (1, -0.75) mixed rainbow
+    const double J = 1, K = -0.1;
+    // grid points per side, a power of two, optional third argument, by default (or 0) chosen from n with
+    // points_per_cell points per mesh cell so the short-range pairs per point do not grow with n
+    // (fewer points per cell: fewer pairs, but larger FFTs, each padded grid holds 64 / points_per_cell bytes per point or more,
+    // and with J and K there are 7 of them, see mesh_grids in particle_mesh.cc)
+    const double points_per_cell = 1.;
+    // bytes the default grid may take, beyond it the grid stops growing with n
+    const double mesh_budget = 4e9;
+    const size_t grids = mesh_grids(J != 0, K != 0);
+    const size_t grid = argc > 3 && stoul(argv[3]) > 0 ? stoul(argv[3]) : grid_for(n, points_per_cell, mesh_budget, grids);
+    // coarsest grid accepted, from the command line or held back by mesh_budget
+    const double max_points_per_cell = 16.;
+    // width of the short-range split in grid spacings, optional fourth argument, 0 for pure particle-mesh
+    // without pair correction; sets the accuracy for pair work growing as split^2, relative force error
+    // against exact sums at split 2 / 3 / 4 is 2.1 / 1.2 / 0.7% on a 64 grid, 1.1 / 0.6 / 0.4% on 256
+    // and 0.8 / 0.4 / 0.3% on 512, so it falls with the grid spacing relative to the swarm, not with n
+    const double split = argc > 4 ? stod(argv[4]) : 2.;
+
+    // initial condition shape and seed, see random.cc
+    const Shape shape = DISK;
+    const uint64_t seed = 6;
+    // natural frequencies, see random.cc - IDENTICAL gives omega_i = 0.1 for all points
+    const Frequencies frequencies = IDENTICAL;
+    const double omega_mean = 0.1, omega_width = 0.;
+    // integrator, in-situ observables and early stopping, see RunOptions in run.cc
+    const RunOptions options;
+
+    if (!power_of_two(grid) || grid < 16) {
+        printf("GRID must be a power of two, at least 16, got %zu\n", grid);
+        return 1;
+    }
+    if (n > max_points_per_cell * grid * grid) {
+        printf("GRID %zu is too coarse for %zu points, the pair sum would grow as n^2, use at least %zu (%.0f MB of mesh, see mesh_budget)\n",
+               grid, n, grid_for(n, max_points_per_cell, HUGE_VAL, grids),
+               mesh_bytes(grid_for(n, max_points_per_cell, HUGE_VAL, grids), grids) / 1048576.);
+        return 1;
+    }
+
+    // number of parallel threads
+    omp_set_num_threads(stoi(argv[1]));
+
+    vector<double> x(3*n);
+    initial_conditions(x, seed, shape, 0, n);
+
+    print_points(n, x, false);
+
+    vector<double> omega(n);
+    natural_frequencies(omega, seed, frequencies, omega_mean, omega_width, 0, n);
+
+    swarm_particle_mesh group(n, J, K, grid, split, omega);
+    run(group, x, dt, options);
+    print_memory(n);
+    print_points(n, x, true);
+
+    return 0;
+}
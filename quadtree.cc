@@ -1,5 +1,9 @@
+#ifndef QUADTREE_CC
+#define QUADTREE_CC
+
 #include <cmath>
 #include <vector>
+#include <algorithm>
 
 // point structure, contains coordinates and phase
 struct Point {
@@ -25,7 +29,20 @@ struct Box {
     }
 };
 
-// each QuadTree contains one point, initializes to square of radius 2 centered at origin
+// opening criterion for the tree walk
+// delta == 0: geometric test, accept a node when cw / dist < theta
+// delta > 0: error-estimated test, accept a node when the estimated relative error of its
+//            monopole contribution is below delta
+struct Opening {
+    double theta, delta;
+
+    Opening(double theta = 0.5, double delta = 0):
+        theta(theta), delta(delta) {}
+
+    bool bounded() const { return delta > 0; }
+};
+
+// each QuadTree leaf holds up to capacity points, initializes to square of radius 2 centered at origin
 struct QuadTree {
     // true if node is a leaf, aka no children
     bool is_leaf;
@@ -40,118 +57,193 @@ struct QuadTree {
 
     // true if there are no points within this tree, aka no centroid
     bool is_empty;
-    // centroid, contains coordinate and phase
+    // centroid, contains coordinate and circular mean phase
     Point centroid;
 
     // "mass", aka how many points
     int mass;
 
+    // maximum number of points kept in a leaf before it subdivides
+    size_t capacity;
+    // points held by this node while it is a leaf
+    std::vector<Point> points;
+
+    // moments used by the error-estimated opening criterion
+    // sum of squared radii, sums of cos / sin of phases, extent of the contained points
+    double sum_r2, sum_cos, sum_sin;
+    double min_x, max_x, min_y, max_y;
+
     // constructor
-    QuadTree(Box b = Box()):
+    QuadTree(Box b = Box(), size_t capacity = 1):
         is_leaf(true), is_empty(true), nW(NULL), nE(NULL), sW(NULL), sE(NULL),
-        centroid(Point()), mass(0), boundary(b) {}
+        centroid(Point()), mass(0), boundary(b), capacity(capacity),
+        sum_r2(0), sum_cos(0), sum_sin(0), min_x(0), max_x(0), min_y(0), max_y(0) {}
 
     // create four children
     void subdivide(){
         double subradius = boundary.radius / 2;
 
         Point qcenter = Point(boundary.center.x - subradius, boundary.center.y + subradius);
-        nW = new QuadTree(Box(qcenter, subradius));
+        nW = new QuadTree(Box(qcenter, subradius), capacity);
 
         qcenter = Point(boundary.center.x + subradius, boundary.center.y + subradius);
-        nE = new QuadTree(Box(qcenter, subradius));
+        nE = new QuadTree(Box(qcenter, subradius), capacity);
 
         qcenter = Point(boundary.center.x - subradius, boundary.center.y - subradius);
-        sW = new QuadTree(Box(qcenter, subradius));
+        sW = new QuadTree(Box(qcenter, subradius), capacity);
 
         qcenter = Point(boundary.center.x + subradius, boundary.center.y - subradius);
-        sE = new QuadTree(Box(qcenter, subradius));
+        sE = new QuadTree(Box(qcenter, subradius), capacity);
 
         is_leaf = false;
     }
 
-    // insert point into quadtree, updating its centroid in the process
+    // child whose quadrant contains p, NULL if p lies on a dividing edge
+    QuadTree* child_for(Point p) {
+        if (nW->boundary.contains(p)) return nW;
+        if (nE->boundary.contains(p)) return nE;
+        if (sE->boundary.contains(p)) return sE;
+        if (sW->boundary.contains(p)) return sW;
+        return NULL;
+    }
+
+    // insert point into quadtree, updating its centroid and moments in the process
     void insert(Point p) {
         // ignore objects that are not in current bounds, this should never happen
         if (!boundary.contains(p)) throw;
 
-        // if there is space in this quad tree, add point
-        if (is_empty) {
-            centroid = p;
-            mass++;
-            is_empty = false;
-            return;
-        }
-
-        // this tree already has a point, aka already has a centroid
+        // update current tree centroid
+        // weighted average of coordinates, circular mean of phases
+        int m_new = mass + 1;
+        centroid.x = (mass * centroid.x + p.x) / m_new;
+        centroid.y = (mass * centroid.y + p.y) / m_new;
+        sum_cos += cos(p.phase);
+        sum_sin += sin(p.phase);
+        centroid.phase = atan2(sum_sin, sum_cos);
+        sum_r2 += p.x * p.x + p.y * p.y;
+        min_x = is_empty ? p.x : std::min(min_x, p.x);
+        max_x = is_empty ? p.x : std::max(max_x, p.x);
+        min_y = is_empty ? p.y : std::min(min_y, p.y);
+        max_y = is_empty ? p.y : std::max(max_y, p.y);
+        mass = m_new;
+        is_empty = false;
 
-        // if no children, subdivide
         if (is_leaf) {
+            // if there is space in this leaf, keep point here
+            if (points.size() < capacity) {
+                points.push_back(p);
+                return;
+            }
+
+            // leaf is full, subdivide and push its points down
             subdivide();
-            if (nW->boundary.contains(centroid)) nW->insert(centroid);
-            else if (nE->boundary.contains(centroid)) nE->insert(centroid);
-            else if (sE->boundary.contains(centroid)) sE->insert(centroid);
-            else if (sW->boundary.contains(centroid)) sW->insert(centroid);
-            else throw;
+            for (size_t i = 0; i < points.size(); i++) {
+                QuadTree* child = child_for(points[i]);
+                if (child == NULL) throw;
+                child->insert(points[i]);
+            }
+            points.clear();
         }
 
-        // update current tree centroid
-        // weighted averages of coordinate and phase
-        int m_new = mass + 1;
-        double x_bar = (mass * centroid.x + p.x) / m_new;
-        double y_bar = (mass * centroid.y + p.y) / m_new;
-        double phase_bar = atan2((mass * sin(centroid.phase) + sin(p.phase)) / m_new,
-                                 (mass * cos(centroid.phase) + cos(p.phase)) / m_new);
-        centroid = Point(x_bar, y_bar, phase_bar);
-        mass = m_new;
-
         // find new children that will eventually accept this point
-        if (nW->boundary.contains(p)) nW->insert(p);
-        else if (nE->boundary.contains(p)) nE->insert(p);
-        else if (sE->boundary.contains(p)) sE->insert(p);
-        else if (sW->boundary.contains(p)) sW->insert(p);
+        QuadTree* child = child_for(p);
+        if (child != NULL) child->insert(p);
     }
 
-    std::vector<double> get_centroids(double x, double y, double theta) {
-        std::vector<double> out;
-
-        if (is_empty){
-            return out;
-        }
+    // centroid updates done while building the tree, one per node on the path of each insert,
+    // which is the sum of the masses of all nodes
+    size_t build_steps() const {
+        if (is_leaf) return mass;
+        return mass + nW->build_steps() + nE->build_steps() + sE->build_steps() + sW->build_steps();
+    }
 
-        double cx = boundary.center.x;
-        double cy = boundary.center.y;
-        double cw = 2 * boundary.radius;
+    // number of nodes, leaves included
+    size_t node_count() const {
+        if (is_leaf) return 1;
+        return 1 + nW->node_count() + nE->node_count() + sE->node_count() + sW->node_count();
+    }
 
-        if (is_leaf ||
-            cw / (sqrt((x - cx) * (x - cx) + (y - cy) * (y - cy))) < theta) {
+    // phase coherence |<e^{i phase}>| of the contained points, scales the J and K terms of the monopole
+    double coherence() const {
+        return sqrt(sum_cos * sum_cos + sum_sin * sum_sin) / mass;
+    }
 
-            if (centroid.x == x && centroid.y == y) return out;
+    // true if the node can stand in for its points as seen from (x, y)
+    bool accept(double x, double y, const Opening &open) const {
+        if (!open.bounded()) {
+            double cx = boundary.center.x;
+            double cy = boundary.center.y;
+            double cw = 2 * boundary.radius;
+            return cw / (sqrt((x - cx) * (x - cx) + (y - cy) * (y - cy))) < open.theta;
+        }
 
-            out.push_back(centroid.x);
-            out.push_back(centroid.y);
-            out.push_back(centroid.phase);
-            out.push_back(mass);
+        // heuristic, not a bound: the relative remainder of a monopole expansion of the 1/|r| type
+        // kernels is of order spread / s^2, with spread the mean squared distance of the points from
+        // the centroid and s the distance from (x, y) to the nearest edge of their bounding box
+        // (Salmon-Warren style); phase variation inside the node, which the coherence-scaled
+        // monopole ignores, is not covered, so delta is calibrated against exact sums by autotune.cc
+        double dx = x - centroid.x, dy = y - centroid.y;
+        double bx = std::max(centroid.x - min_x, max_x - centroid.x);
+        double by = std::max(centroid.y - min_y, max_y - centroid.y);
+        double s = sqrt(dx * dx + dy * dy) - sqrt(bx * bx + by * by);
+        if (s <= 0) return false;
+
+        double spread = std::max(0., sum_r2 / mass - (centroid.x * centroid.x + centroid.y * centroid.y));
+        return spread / (s * s) < open.delta;
+    }
 
-            return out;
+    // append (x, y, phase, mass, coherence) of every node accepted by the walk from (x, y)
+    // visits, if given, counts the nodes the walk reaches
+    void collect(double x, double y, const Opening &open, std::vector<double> &out, size_t *visits = NULL) const {
+        if (visits != NULL) (*visits)++;
+        if (is_empty) return;
+
+        // a single point is always taken as is, anything else is opened unless the criterion accepts it
+        if ((!is_leaf || points.size() > 1) && !accept(x, y, open)) {
+            if (is_leaf) {
+                // opened leaf, interact with its points directly
+                for (size_t i = 0; i < points.size(); i++) {
+                    if (points[i].x == x && points[i].y == y) continue;
+
+                    out.push_back(points[i].x);
+                    out.push_back(points[i].y);
+                    out.push_back(points[i].phase);
+                    out.push_back(1);
+                    out.push_back(1);
+                }
+                return;
+            }
+
+            nW->collect(x, y, open, out, visits);
+            nE->collect(x, y, open, out, visits);
+            sE->collect(x, y, open, out, visits);
+            sW->collect(x, y, open, out, visits);
+            return;
         }
 
-        std::vector<double> v1, v2, v3, v4;
-        v1 = nW->get_centroids(x, y, theta);
-        v2 = nE->get_centroids(x, y, theta);
-        v3 = sE->get_centroids(x, y, theta);
-        v4 = sW->get_centroids(x, y, theta);
+        if (centroid.x == x && centroid.y == y) return;
 
-        out.insert(out.end(), v1.begin(), v1.end());
-        out.insert(out.end(), v2.begin(), v2.end());
-        out.insert(out.end(), v3.begin(), v3.end());
-        out.insert(out.end(), v4.begin(), v4.end());
+        out.push_back(centroid.x);
+        out.push_back(centroid.y);
+        out.push_back(centroid.phase);
+        out.push_back(mass);
+        out.push_back(coherence());
+    }
 
+    std::vector<double> get_centroids(double x, double y, const Opening &open) const {
+        std::vector<double> out;
+        collect(x, y, open, out);
         return out;
     }
 
+    std::vector<double> get_centroids(double x, double y, double theta) const {
+        return get_centroids(x, y, Opening(theta));
+    }
+
     // destructor
     ~QuadTree() {
         delete nW; delete nE; delete sW; delete sE;
     }
 };
+
+#endif
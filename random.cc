@@ -0,0 +1,125 @@
+#ifndef RANDOM_CC
+#define RANDOM_CC
+
+#include <cmath>
+#include <vector>
+#include <stdint.h>
+
+// Philox4x32-10 counter-based generator (Salmon et al. 2011)
+// every output block is a pure function of (counter, key), so any particle can be drawn
+// independently on any thread or rank without shared state
+struct Philox {
+    uint32_t v[4];
+
+    Philox(uint32_t c0, uint32_t c1, uint32_t c2, uint32_t c3, uint64_t key) {
+        uint32_t k0 = (uint32_t) key, k1 = (uint32_t) (key >> 32);
+        v[0] = c0; v[1] = c1; v[2] = c2; v[3] = c3;
+        for(int r = 0; r < 10; r++) {
+            uint64_t p0 = (uint64_t) 0xD2511F53 * v[0];
+            uint64_t p1 = (uint64_t) 0xCD9E8D57 * v[2];
+            uint32_t c[4] = {(uint32_t) (p1 >> 32) ^ v[1] ^ k0, (uint32_t) p1,
+                             (uint32_t) (p0 >> 32) ^ v[3] ^ k1, (uint32_t) p0};
+            v[0] = c[0]; v[1] = c[1]; v[2] = c[2]; v[3] = c[3];
+            k0 += 0x9E3779B9;
+            k1 += 0xBB67AE85;
+        }
+    }
+
+    // uniform doubles in [0, 1) with 53 random bits, two per block
+    double uniform(int k) const {
+        return ((((uint64_t) v[2*k] << 32) | v[2*k + 1]) >> 11) * (1. / 9007199254740992.);
+    }
+};
+
+// independent streams of draws per particle
+enum Stream { POSITION_STREAM = 0, PHASE_STREAM = 1, FREQUENCY_STREAM = 2 };
+
+// two uniforms on [0, 1) for particle i, draw number d of the given stream
+inline Philox draw(uint64_t seed, size_t i, uint32_t stream, uint32_t d = 0) {
+    return Philox((uint32_t) i, (uint32_t) ((uint64_t) i >> 32), d, stream, seed);
+}
+
+// initial condition shapes
+// DISK: radius and angle uniform in the unit circle (denser at the center), as in the original solvers
+// UNIFORM_DISK: uniform area density in the unit circle
+// RING: thin annulus 0.9 < r < 1
+// SQUARE: uniform in [-1, 1]^2
+// GAUSSIAN: isotropic normal with standard deviation 0.5, truncated at r = 1.5
+enum Shape { DISK, UNIFORM_DISK, RING, SQUARE, GAUSSIAN };
+
+// fill x with positions and phases of particles [begin, end) as (x, y, phase) triples
+// the result depends only on seed and particle index, not on the thread or rank count
+void initial_conditions(std::vector<double> &x, uint64_t seed, Shape shape, size_t begin, size_t end) {
+#pragma omp parallel for
+    for(size_t i = begin; i < end; i++) {
+        size_t xi = 3*(i - begin), yi = 3*(i - begin) + 1, ti = 3*(i - begin) + 2;
+        Philox u = draw(seed, i, POSITION_STREAM);
+        double a = u.uniform(0), b = u.uniform(1);
+        switch (shape) {
+        case DISK:
+            x[xi] = a*cos(2.*M_PI*b);
+            x[yi] = a*sin(2.*M_PI*b);
+            break;
+        case UNIFORM_DISK:
+            x[xi] = sqrt(a)*cos(2.*M_PI*b);
+            x[yi] = sqrt(a)*sin(2.*M_PI*b);
+            break;
+        case RING:
+            x[xi] = (0.9 + 0.1*a)*cos(2.*M_PI*b);
+            x[yi] = (0.9 + 0.1*a)*sin(2.*M_PI*b);
+            break;
+        case SQUARE:
+            x[xi] = 2.*a - 1.;
+            x[yi] = 2.*b - 1.;
+            break;
+        case GAUSSIAN: {
+            // Box-Muller, redrawing with the next counter until inside the truncation radius
+            double r = 0.5*sqrt(-2.*log(1. - a));
+            for(uint32_t d = 1; r >= 1.5; d++) {
+                u = draw(seed, i, POSITION_STREAM, d);
+                a = u.uniform(0);
+                b = u.uniform(1);
+                r = 0.5*sqrt(-2.*log(1. - a));
+            }
+            x[xi] = r*cos(2.*M_PI*b);
+            x[yi] = r*sin(2.*M_PI*b);
+            break;
+        }
+        }
+        x[ti] = draw(seed, i, PHASE_STREAM).uniform(0)*2.*M_PI;
+    }
+}
+
+// natural frequency distributions, centred on mean with scale width
+// IDENTICAL: every point has mean, as in the original solvers
+// UNIFORM: uniform on [mean - width, mean + width]
+// LORENTZIAN: Cauchy with half width width, the classic Kuramoto choice
+// NORMAL: normal with standard deviation width
+enum Frequencies { IDENTICAL, UNIFORM, LORENTZIAN, NORMAL };
+
+// fill omega with natural frequencies of points [begin, end), like initial_conditions the result
+// depends only on seed and point index
+void natural_frequencies(std::vector<double> &omega, uint64_t seed, Frequencies distribution,
+                         double mean, double width, size_t begin, size_t end) {
+#pragma omp parallel for
+    for(size_t i = begin; i < end; i++) {
+        Philox u = draw(seed, i, FREQUENCY_STREAM);
+        double a = u.uniform(0), b = u.uniform(1);
+        switch (distribution) {
+        case IDENTICAL:
+            omega[i - begin] = mean;
+            break;
+        case UNIFORM:
+            omega[i - begin] = mean + width*(2.*a - 1.);
+            break;
+        case LORENTZIAN:
+            omega[i - begin] = mean + width*tan(M_PI*(a - 0.5));
+            break;
+        case NORMAL:
+            omega[i - begin] = mean + width*sqrt(-2.*log(1. - a))*cos(2.*M_PI*b);
+            break;
+        }
+    }
+}
+
+#endif
@@ -0,0 +1,104 @@
+#ifndef RUN_CC
+#define RUN_CC
+
+#include <vector>
+#include <fstream>
+#include <cstdio>
+#include <omp.h>
+#include <boost/numeric/odeint.hpp>
+#include "./low_storage_rk.cc"
+#include "./observables.cc"
+
+// how the mains integrate, shared by all solvers
+// low_storage: low-storage 2N Runge-Kutta (low_storage_rk.cc) instead of odeint's runge_kutta4, for memory-bound
+//              runs: 2 state-sized vectors instead of 6, for 5 right-hand side evaluations per step instead of 4
+// observe_every: in-situ observables written to observables.csv every observe_every steps, 0 for none
+// converge_tol: integration stops early once they change by less than converge_tol (0 never stops)
+struct RunOptions {
+    double t_end;
+    bool low_storage;
+    size_t observe_every;
+    double converge_tol;
+
+    RunOptions(double t_end = 50., bool low_storage = false, size_t observe_every = 10, double converge_tol = 0.):
+        t_end(t_end), low_storage(low_storage), observe_every(observe_every), converge_tol(converge_tol) {}
+};
+
+// observer that does nothing, for solvers without one of their own
+struct no_observer {
+    template<class State>
+    void operator()(const State &x, const State &dxdt, double t) {}
+};
+
+// calls first then second at every step
+template<class First, class Second>
+struct chained_observer {
+    First &first;
+    Second &second;
+
+    chained_observer(First &first_, Second &second_): first(first_), second(second_) {}
+
+    template<class State>
+    void operator()(const State &x, const State &dxdt, double t) {
+        first(x, dxdt, t);
+        second(x, dxdt, t);
+    }
+};
+
+// integrates group over [0, options.t_end] with the stepper chosen by options, calling
+// observer(x, dxdt, t) at t = 0, dt, ..., t_end until it throws converged
+// dxdt is f(x, t) as computed by the first stage of the step taken from t anyway, so observing costs
+// neither an extra evaluation of group nor a state-sized register; only the sample at t_end
+// evaluates group once more
+// verbose processes print the outcome and time taken
+template<class System, class State, class Observer>
+void integrate_observed(System &group, State &x, double dt, const RunOptions &options, Observer &observer,
+                        bool verbose = true) {
+    using namespace boost::numeric::odeint;
+    const size_t steps = (size_t) (options.t_end / dt + 0.5);
+    double t0 = omp_get_wtime();
+    try {
+        if (options.low_storage) {
+            low_storage_rk4<State> stepper;
+            for(size_t k = 0; k < steps; k++) {
+                stepper.do_step(boost::ref(group), x, k * dt, dt, observer);
+            }
+            observer(x, stepper.derivative(boost::ref(group), x, steps * dt), steps * dt);
+        } else {
+            // runge_kutta4 takes the first stage from dxdt instead of its own register
+            runge_kutta4<State> stepper;
+            State dxdt;
+            resize(dxdt, x);
+            for(size_t k = 0; k <= steps; k++) {
+                group(x, dxdt, k * dt);
+                observer(x, dxdt, k * dt);
+                if (k < steps) stepper.do_step(boost::ref(group), x, dxdt, k * dt, dt);
+            }
+        }
+    } catch (converged &c) {
+        if (verbose) printf("Converged at t = %.1f\n", c.t);
+    }
+    if (verbose) printf("Time taken: %f\n", omp_get_wtime()-t0);
+}
+
+// runs a shared-memory solver with its in-situ observables written to observables.csv,
+// extra is called before them at every step
+template<class System, class Extra>
+void run(System &group, std::vector<double> &x, double dt, const RunOptions &options, Extra &extra) {
+    std::ofstream file;
+    if (options.observe_every > 0) {
+        file.open("observables.csv");
+        print_observables_header(file);
+    }
+    insitu_observer insitu(file, options.observe_every, options.converge_tol);
+    chained_observer<Extra, insitu_observer> observer(extra, insitu);
+    integrate_observed(group, x, dt, options, observer);
+}
+
+template<class System>
+void run(System &group, std::vector<double> &x, double dt, const RunOptions &options) {
+    no_observer none;
+    run(group, x, dt, options, none);
+}
+
+#endif